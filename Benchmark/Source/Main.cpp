@@ -0,0 +1,419 @@
+/*
+  Headless benchmark of the processing classes
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include <iostream>
+#include "../../Source/Beamformer.h"
+
+/** Options of a run */
+struct BenchmarkOptions {
+    /** Reduced sweep, for a quick comparison */
+    bool quick = false;
+    /** Audio processed by each case [s] */
+    double audioSeconds = 2;
+    /** Maximum time to wait for the filters of a beamformer [s] */
+    double designTimeout = 60;
+    /** Run the accuracy checks only */
+    bool checkOnly = false;
+};
+
+/** Build counting the allocations of the timed loops, the RealtimeCheck configuration.
+ The checker intercepts every allocation and lock, so such a build reports the allocations only, and the timings come
+ from a Release build without the checker
+ */
+static constexpr bool countAllocations = EBEAMER_RT_CHECK != 0;
+
+/** Start a result */
+static var makeResult(const String &benchmark) {
+    auto result = new DynamicObject();
+    result->setProperty("benchmark", benchmark);
+    return var(result);
+}
+
+/** Fill a buffer with noise */
+static void fillNoise(AudioBuffer<float> &buffer, Random &random) {
+    for (auto channelIdx = 0; channelIdx < buffer.getNumChannels(); channelIdx++) {
+        auto samples = buffer.getWritePointer(channelIdx);
+        for (auto sampleIdx = 0; sampleIdx < buffer.getNumSamples(); sampleIdx++) {
+            samples[sampleIdx] = random.nextFloat() * 2 - 1;
+        }
+    }
+}
+
+/** Number of rows of a configuration, as built by the Beamformer */
+static int getNumRows(MicConfig mic) {
+    switch (mic) {
+        case URA_2ESTICK:
+        case URA_2x2ESTICK:
+            return 2;
+        case URA_3ESTICK:
+            return 3;
+        case URA_4ESTICK:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+/** Median of a stage from a profiler [ns], 0 if the stage never ran */
+static double getStageMedian(StageProfiler &profiler, StageProfiler::Stage stage) {
+    return profiler.getSnapshot(stage).getPercentile(0.5) * 1e9;
+}
+
+/** Number of runs of a stage from a profiler */
+static int getStageRuns(StageProfiler &profiler, StageProfiler::Stage stage) {
+    const auto snapshot = profiler.getSnapshot(stage);
+    uint64 numRuns = 0;
+    for (auto count : snapshot.counts) {
+        numRuns += count;
+    }
+    return int(numRuns);
+}
+
+// ==============================================================================
+
+/** Start the result of an accuracy check */
+static var makeCheck(const String &check, double maxError, double tolerance) {
+    auto result = new DynamicObject();
+    result->setProperty("check", check);
+    result->setProperty("maxError", maxError);
+    result->setProperty("tolerance", tolerance);
+    result->setProperty("passed", maxError <= tolerance);
+    return var(result);
+}
+
+/** steeringVectors against the direct exp(-j2pi*f*tau), for delays up to 200 samples and each FFT size.
+ 
+ @return false if the error exceeds the tolerance
+ */
+static bool checkSteeringVectors(Array<var> &checks) {
+
+    /** The phasors are accumulated in single precision for at most renormPeriod bins */
+    const double tolerance = 1e-5;
+    const int numMic = 64;
+    const float maxDelay = 200;
+
+    bool passed = true;
+    Random random(1);
+    for (auto sampleRate : {48000.0, 96000.0}) {
+        for (auto fftOrder : {8, 10, 12}) {
+            const int fftSize = 1 << fftOrder;
+            const float freqStep = float(sampleRate / fftSize);
+            Vec delays(numMic);
+            for (auto micIdx = 0; micIdx < numMic; micIdx++) {
+                delays(micIdx) = random.nextFloat() * maxDelay / float(sampleRate);
+            }
+
+            CpxMtx steering;
+            steeringVectors(steering, fftSize / 2 + 1, freqStep, delays);
+
+            double maxError = 0;
+            for (auto freqIdx = 0; freqIdx <= fftSize / 2; freqIdx++) {
+                for (auto micIdx = 0; micIdx < numMic; micIdx++) {
+                    const auto expected = std::polar(1.0, -2 * MathConstants<double>::pi * double(freqStep) * freqIdx *
+                                                          double(delays(micIdx)));
+                    maxError = jmax(maxError, std::abs(std::complex<double>(steering(freqIdx, micIdx)) - expected));
+                }
+            }
+
+            auto check = makeCheck("steeringVectors", maxError, tolerance);
+            check.getDynamicObject()->setProperty("sampleRate", sampleRate);
+            check.getDynamicObject()->setProperty("fftSize", fftSize);
+            checks.add(check);
+            passed &= maxError <= tolerance;
+        }
+    }
+    return passed;
+}
+
+// ==============================================================================
+
+/** Beamformer::processBlock on the calling thread, and the DOA cycles running alongside.
+
+ The filters are designed and the DOA is warmed up before timing.
+ @param withDoa: also add a result for the DOA cycle
+ */
+static void benchmarkBeamformer(MicConfig mic, double sampleRate, int blockSize, int numBeams, bool withDoa,
+                                const BenchmarkOptions &options, Array<var> &results) {
+
+    /** The DOA thread computes a new estimate as soon as a new input block is available */
+    const float doaRefreshRate = 1000;
+    Beamformer beamformer(numBeams, mic, sampleRate, blockSize, doaRefreshRate);
+
+    Random random(1);
+    AudioBuffer<float> input(Beamformer::getNumMic(mic), blockSize);
+    AudioBuffer<float> beams(numBeams, blockSize);
+    fillNoise(input, random);
+
+    /** Wait for the filters, feeding the DOA. The parameters are requested at each block, as the plugin does */
+    const auto designStartTicks = Time::getHighResolutionTicks();
+    while (!(beamformer.areBeamsReady() && beamformer.isDoaReady()) &&
+           Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - designStartTicks) < options.designTimeout) {
+        for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+            const float steer = numBeams > 1 ? -1 + 2.f * beamIdx / (numBeams - 1) : 0;
+            beamformer.setBeamParameters(beamIdx, {steer, 0, 0.3f});
+        }
+        beamformer.processBlock(input);
+        beamformer.getBeams(beams);
+        Thread::sleep(1);
+    }
+    const bool ready = beamformer.areBeamsReady();
+
+    /** Warm up, then time the blocks only */
+    for (auto blockIdx = 0; blockIdx < 16; blockIdx++) {
+        beamformer.processBlock(input);
+        beamformer.getBeams(beams);
+    }
+    beamformer.getProfiler().reset();
+
+    const auto numBlocks = jmax(16, int(options.audioSeconds * sampleRate / blockSize));
+    const auto allocationsStart = RealtimeCheck::getNumAllocations();
+    int64 maxBlockTicks = 0;
+    const auto startTicks = Time::getHighResolutionTicks();
+    {
+        RealtimeCheck::Scope realtimeScope;
+        for (auto blockIdx = 0; blockIdx < numBlocks; blockIdx++) {
+            const auto blockStartTicks = Time::getHighResolutionTicks();
+            beamformer.processBlock(input);
+            beamformer.getBeams(beams);
+            maxBlockTicks = jmax(maxBlockTicks, Time::getHighResolutionTicks() - blockStartTicks);
+        }
+    }
+    const auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+    const auto numAllocations = RealtimeCheck::getNumAllocations() - allocationsStart;
+
+    auto &profiler = beamformer.getProfiler();
+    auto result = makeResult("processBlock");
+    auto object = result.getDynamicObject();
+    object->setProperty("micConfig", micConfigLabels[mic]);
+    object->setProperty("sampleRate", sampleRate);
+    object->setProperty("blockSize", blockSize);
+    object->setProperty("numBeams", numBeams);
+    object->setProperty("filtersReady", ready);
+    object->setProperty("numBlocks", numBlocks);
+    if (countAllocations) {
+        object->setProperty("allocationsPerBlock", double(numAllocations) / numBlocks);
+    } else {
+        object->setProperty("nsPerBlock", elapsed * 1e9 / numBlocks);
+        object->setProperty("maxNsPerBlock", Time::highResolutionTicksToSeconds(maxBlockTicks) * 1e9);
+        object->setProperty("realTimeFactor", elapsed / (double(numBlocks) * blockSize / sampleRate));
+        object->setProperty("inputFFTMedianNs", getStageMedian(profiler, StageProfiler::inputFFT));
+        object->setProperty("convolutionMedianNs", getStageMedian(profiler, StageProfiler::convolution));
+        object->setProperty("ifftMedianNs", getStageMedian(profiler, StageProfiler::ifft));
+    }
+    results.add(result);
+
+    if (withDoa && !countAllocations) {
+        /** At least one DOA cycle, feeding input blocks at the real-time rate once the timed blocks are over */
+        const auto doaStartTicks = Time::getHighResolutionTicks();
+        while (getStageRuns(profiler, StageProfiler::doaCycle) == 0 && beamformer.isDoaReady() &&
+               Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - doaStartTicks) < options.designTimeout) {
+            beamformer.processBlock(input);
+            beamformer.getBeams(beams);
+            Thread::sleep(jmax(1, roundToInt(1000 * blockSize / sampleRate)));
+        }
+        const auto doaSnapshot = profiler.getSnapshot(StageProfiler::doaCycle);
+        auto doaResult = makeResult("doaCycle");
+        auto doaObject = doaResult.getDynamicObject();
+        doaObject->setProperty("micConfig", micConfigLabels[mic]);
+        doaObject->setProperty("sampleRate", sampleRate);
+        doaObject->setProperty("blockSize", blockSize);
+        doaObject->setProperty("numCycles", getStageRuns(profiler, StageProfiler::doaCycle));
+        doaObject->setProperty("nsPerCycle", doaSnapshot.getPercentile(0.5) * 1e9);
+        doaObject->setProperty("maxNsPerCycle", doaSnapshot.max * 1e9);
+        results.add(doaResult);
+    }
+}
+
+/** FarfieldURA::getFir, sweeping the steering direction */
+static void benchmarkGetFir(MicConfig mic, double sampleRate, const BenchmarkOptions &options, Array<var> &results) {
+
+    const auto numMic = Beamformer::getNumMic(mic);
+    DAS::FarfieldURA alg(0.03, 0.03, numMic, getNumRows(mic), float(sampleRate), 343);
+    AudioBuffer<float> fir(numMic, alg.getFirLen());
+
+    const auto numCalls = options.quick ? 20 : 100;
+    const auto allocationsStart = RealtimeCheck::getNumAllocations();
+    const auto startTicks = Time::getHighResolutionTicks();
+    {
+        RealtimeCheck::Scope realtimeScope;
+        for (auto callIdx = 0; callIdx < numCalls; callIdx++) {
+            const float steer = -1 + 2.f * callIdx / numCalls;
+            alg.getFir(fir, {steer, isLinearArray(mic) ? 0 : -steer, 0.3f});
+        }
+    }
+    const auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+
+    auto result = makeResult("getFir");
+    auto object = result.getDynamicObject();
+    object->setProperty("micConfig", micConfigLabels[mic]);
+    object->setProperty("sampleRate", sampleRate);
+    object->setProperty("firLen", alg.getFirLen());
+    if (countAllocations) {
+        object->setProperty("allocationsPerCall",
+                            double(RealtimeCheck::getNumAllocations() - allocationsStart) / numCalls);
+    } else {
+        object->setProperty("nsPerCall", elapsed * 1e9 / numCalls);
+    }
+    results.add(result);
+}
+
+/** AudioBufferFFT prepare for convolution, convolve and inverse FFT, for each channel */
+static void benchmarkAudioBufferFFT(int fftOrder, const BenchmarkOptions &options, Array<var> &results) {
+
+    const int numChannels = 16;
+    auto fft = getSharedFft(fftOrder);
+    const auto fftSize = fft->getSize();
+
+    Random random(1);
+    AudioBuffer<float> timeSeries(numChannels, fftSize / 2);
+    fillNoise(timeSeries, random);
+
+    AudioBufferFFT input(numChannels, fft);
+    AudioBufferFFT filter(numChannels, fft);
+    AudioBufferFFT output(1, fft);
+    for (auto channelIdx = 0; channelIdx < numChannels; channelIdx++) {
+        filter.setTimeSeriesForConvolution(channelIdx, timeSeries);
+    }
+    filter.setReadyForConvolution();
+
+    const auto numRounds = jmax(4, int((options.quick ? 1 << 16 : 1 << 20) / fftSize));
+    double prepareSeconds = 0, convolveSeconds = 0, ifftSeconds = 0;
+    const auto allocationsStart = RealtimeCheck::getNumAllocations();
+    {
+        RealtimeCheck::Scope realtimeScope;
+        for (auto roundIdx = 0; roundIdx < numRounds; roundIdx++) {
+            auto ticks = Time::getHighResolutionTicks();
+            for (auto channelIdx = 0; channelIdx < numChannels; channelIdx++) {
+                input.setTimeSeriesForConvolution(channelIdx, timeSeries);
+            }
+            input.setReadyForConvolution();
+            auto nextTicks = Time::getHighResolutionTicks();
+            prepareSeconds += Time::highResolutionTicksToSeconds(nextTicks - ticks);
+
+            ticks = nextTicks;
+            output.clear();
+            for (auto channelIdx = 0; channelIdx < numChannels; channelIdx++) {
+                output.convolveAndAdd(0, input, channelIdx, filter, channelIdx);
+            }
+            nextTicks = Time::getHighResolutionTicks();
+            convolveSeconds += Time::highResolutionTicksToSeconds(nextTicks - ticks);
+
+            ticks = nextTicks;
+            output.getTimeSeries(0);
+            ifftSeconds += Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - ticks);
+        }
+    }
+
+    const auto numChannelRounds = double(numRounds) * numChannels;
+    auto result = makeResult("audioBufferFFT");
+    auto object = result.getDynamicObject();
+    object->setProperty("fftSize", fftSize);
+    if (countAllocations) {
+        object->setProperty("allocationsPerRound",
+                            double(RealtimeCheck::getNumAllocations() - allocationsStart) / numRounds);
+    } else {
+        object->setProperty("prepareNsPerChannel", prepareSeconds * 1e9 / numChannelRounds);
+        object->setProperty("convolveNsPerChannel", convolveSeconds * 1e9 / numChannelRounds);
+        object->setProperty("ifftNs", ifftSeconds * 1e9 / numRounds);
+    }
+    results.add(result);
+}
+
+// ==============================================================================
+
+/** Print the usage */
+static void printUsage() {
+    std::cerr << "Usage: EbeamerBenchmark [--quick] [--check] [--seconds <audio seconds per case>] [--output <file.json>]\n"
+                 "Writes the results as JSON to the output file, or to stdout. --check runs the accuracy checks only\n"
+                 "Exits with 1 if an accuracy check fails\n"
+                 "The Release configuration reports the timings, the RealtimeCheck one the allocations\n";
+}
+
+int main(int argc, char *argv[]) {
+
+    BenchmarkOptions options;
+    File outputFile;
+    for (auto argIdx = 1; argIdx < argc; argIdx++) {
+        const String arg(argv[argIdx]);
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--check") {
+            options.checkOnly = true;
+        } else if (arg == "--seconds" && argIdx + 1 < argc) {
+            options.audioSeconds = String(argv[++argIdx]).getDoubleValue();
+        } else if (arg == "--output" && argIdx + 1 < argc) {
+            outputFile = File::getCurrentWorkingDirectory().getChildFile(argv[++argIdx]);
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<MicConfig> micConfigs;
+    for (auto configIdx = 0; configIdx < micConfigLabels.size(); configIdx++) {
+        micConfigs.push_back(static_cast<MicConfig>(configIdx));
+    }
+    std::vector<double> sampleRates = {48000, 96000};
+    std::vector<int> blockSizes = {32, 128, 512};
+    std::vector<int> beamCounts = {1, 2, 8, 16};
+    std::vector<int> fftOrders = {8, 9, 10, 11, 12};
+    if (options.quick) {
+        micConfigs = {ULA_1ESTICK, URA_4ESTICK};
+        sampleRates = {48000};
+        blockSizes = {128};
+        beamCounts = {2};
+        fftOrders = {10};
+    }
+
+    /** Accuracy of the optimized computations against their direct definition */
+    Array<var> checks;
+    std::cerr << "checks" << std::endl;
+    bool checksPassed = checkSteeringVectors(checks);
+    if (options.checkOnly) {
+        micConfigs.clear();
+        fftOrders.clear();
+    }
+
+    Array<var> results;
+    for (auto fftOrder : fftOrders) {
+        std::cerr << "audioBufferFFT " << (1 << fftOrder) << std::endl;
+        benchmarkAudioBufferFFT(fftOrder, options, results);
+    }
+    for (auto mic : micConfigs) {
+        for (auto sampleRate : sampleRates) {
+            std::cerr << "getFir " << micConfigLabels[mic] << " " << sampleRate << std::endl;
+            benchmarkGetFir(mic, sampleRate, options, results);
+            for (auto blockSize : blockSizes) {
+                for (auto numBeams : beamCounts) {
+                    std::cerr << "processBlock " << micConfigLabels[mic] << " " << sampleRate << " Hz, " << blockSize
+                              << " samples, " << numBeams << " beams" << std::endl;
+                    benchmarkBeamformer(mic, sampleRate, blockSize, numBeams, numBeams == beamCounts.front(), options,
+                                        results);
+                }
+            }
+        }
+    }
+
+    auto report = new DynamicObject();
+    report->setProperty("version", 3);
+    report->setProperty("cpu", SystemStats::getCpuModel());
+    report->setProperty("numCpus", SystemStats::getNumCpus());
+    report->setProperty("os", SystemStats::getOperatingSystemName());
+    report->setProperty("allocationsCounted", countAllocations);
+    report->setProperty("checks", checks);
+    report->setProperty("checksPassed", checksPassed);
+    report->setProperty("results", results);
+    const auto json = JSON::toString(var(report));
+
+    if (outputFile == File()) {
+        std::cout << json << std::endl;
+    } else if (!outputFile.replaceWithText(json)) {
+        std::cerr << "Error: cannot write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+    return checksPassed ? 0 : 1;
+}
@@ -1,193 +1,317 @@
-/*
- Audio Buffer in FFT domain
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
-*/
-
-#include "AudioBufferFFT.h"
-
-
-/** After each FFT, this function is called to allow convolution to be performed with only 4 SIMD functions calls.
-    Credits to juce_Convolution.cpp
- */
-void AudioBufferFFT::prepareForConvolution(float *samples, int fftSize) const {
-    int FFTSizeDiv2 = fftSize / 2;
-
-    for (size_t i = 0; i < FFTSizeDiv2; i++)
-        samples[i] = samples[2 * i];
-
-    samples[FFTSizeDiv2] = 0;
-
-    for (size_t i = 1; i < FFTSizeDiv2; i++)
-        samples[i + FFTSizeDiv2] = -samples[2 * (fftSize - i) + 1];
-}
-
-/** Does the convolution operation itself only on half of the frequency domain samples.
-    Credits to juce_Convolution.cpp*/
-void AudioBufferFFT::convolutionProcessingAndAccumulate(const float *input, const float *impulse, float *output,
-                                                        int fftSize) const {
-    int FFTSizeDiv2 = fftSize / 2;
-
-    FloatVectorOperations::addWithMultiply(output, input, impulse, FFTSizeDiv2);
-    FloatVectorOperations::subtractWithMultiply(output, &(input[FFTSizeDiv2]), &(impulse[FFTSizeDiv2]), FFTSizeDiv2);
-
-    FloatVectorOperations::addWithMultiply(&(output[FFTSizeDiv2]), input, &(impulse[FFTSizeDiv2]), FFTSizeDiv2);
-    FloatVectorOperations::addWithMultiply(&(output[FFTSizeDiv2]), &(input[FFTSizeDiv2]), impulse, FFTSizeDiv2);
-
-    output[fftSize] += input[fftSize] * impulse[fftSize];
-}
-
-/** Undo the re-organization of samples from the function prepareForConvolution.
-     Then, takes the conjugate of the frequency domain first half of samples, to fill the
-     second half, so that the inverse transform will return real samples in the time domain.
-     Credits to juce_Convolution.cpp
- */
-void AudioBufferFFT::updateSymmetricFrequencyDomainData(float *samples, int fftSize) const {
-    auto FFTSizeDiv2 = fftSize / 2;
-
-    for (size_t i = 1; i < FFTSizeDiv2; i++) {
-        samples[2 * (fftSize - i)] = samples[i];
-        samples[2 * (fftSize - i) + 1] = -samples[FFTSizeDiv2 + i];
-    }
-
-    samples[1] = 0.f;
-
-    for (size_t i = 1; i < FFTSizeDiv2; i++) {
-        samples[2 * i] = samples[2 * (fftSize - i)];
-        samples[2 * i + 1] = -samples[2 * (fftSize - i) + 1];
-    }
-}
-
-AudioBufferFFT::AudioBufferFFT(int numChannels, std::shared_ptr<dsp::FFT> &fft_) {
-    fft = fft_;
-    convBuffer = AudioBuffer<float>(1, fft->getSize() * 2);
-    setSize(numChannels, fft->getSize() * 2);
-}
-
-AudioBufferFFT::AudioBufferFFT(const AudioBuffer<float> &in_, std::shared_ptr<dsp::FFT> &fft_) {
-    fft = fft_;
-    convBuffer = AudioBuffer<float>(1, fft->getSize() * 2);
-    setSize(in_.getNumChannels(), fft->getSize() * 2);
-    setTimeSeries(in_);
-}
-
-void AudioBufferFFT::reset() {
-    clear();
-    readyForConvolution = false;
-}
-
-void AudioBufferFFT::setTimeSeries(const AudioBuffer<float> &in_) {
-    jassert(fft->getSize() >= in_.getNumSamples());
-
-    clear();
-    for (int channelIdx = 0; channelIdx < jmin(getNumChannels(), in_.getNumChannels()); ++channelIdx) {
-        copyFrom(channelIdx, 0, in_, channelIdx, 0, in_.getNumSamples());
-    }
-    // perform FFT
-    for (int channelIdx = 0; channelIdx < jmin(getNumChannels(), in_.getNumChannels()); ++channelIdx) {
-        fft->performRealOnlyForwardTransform(getWritePointer(channelIdx));
-    }
-
-    readyForConvolution = false;
-}
-
-void AudioBufferFFT::updateSymmetricFrequency() {
-    if (readyForConvolution) {
-        for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
-            updateSymmetricFrequencyDomainData(getWritePointer(channelIdx), fft->getSize());
-        }
-        readyForConvolution = false;
-    }
-}
-
-void AudioBufferFFT::copyToTimeSeries(AudioBuffer<float> &out) {
-    updateSymmetricFrequency();
-    for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
-        convBuffer.copyFrom(0, 0, *(this), channelIdx, 0, fft->getSize() * 2);
-        fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
-        out.copyFrom(channelIdx, 0, convBuffer, 0, 0, fft->getSize());
-    }
-}
-
-void AudioBufferFFT::addToTimeSeries(AudioBuffer<float> &out) {
-    updateSymmetricFrequency();
-    for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
-        convBuffer.copyFrom(0, 0, *(this), channelIdx, 0, fft->getSize() * 2);
-        fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
-        out.addFrom(channelIdx, 0, convBuffer, 0, 0, fft->getSize());
-    }
-}
-
-void AudioBufferFFT::copyToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh) {
-    updateSymmetricFrequency();
-    convBuffer.copyFrom(0, 0, *(this), sourceCh, 0, fft->getSize() * 2);
-    fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
-    dest.copyFrom(destCh, 0, convBuffer, 0, 0, fft->getSize());
-}
-
-void AudioBufferFFT::addToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh) {
-    updateSymmetricFrequency();
-    convBuffer.copyFrom(0, 0, *(this), sourceCh, 0, fft->getSize() * 2);
-    fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
-    dest.addFrom(destCh, 0, convBuffer, 0, 0, fft->getSize());
-}
-
-void AudioBufferFFT::prepareForConvolution() {
-    if (!readyForConvolution) {
-        for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
-            prepareForConvolution(getWritePointer(channelIdx), fft->getSize());
-        }
-        readyForConvolution = true;
-    } else {
-        // prepareForConvolution should not be called if
-        jassertfalse;
-    }
-}
-
-void AudioBufferFFT::convolveAndAdd(int outputChannel, const AudioBufferFFT &in_, int inChannel, AudioBufferFFT &filter_,
-                              int filterChannel) {
-
-    jassert(in_.isReadyForConvolution());
-    jassert(filter_.isReadyForConvolution());
-
-    convolutionProcessingAndAccumulate(in_.getReadPointer(inChannel), filter_.getReadPointer(filterChannel),
-                                       getWritePointer(outputChannel), fft->getSize());
-
-    readyForConvolution = true;
-}
-
-void AudioBufferFFT::convolve(int outputChannel, const AudioBufferFFT &in_, int inChannel, AudioBufferFFT &filter_,
-                              int filterChannel) {
-
-    clear(outputChannel, 0, getNumSamples());
-    convolveAndAdd(outputChannel, in_, inChannel, filter_, filterChannel);
-}
-
-AudioBufferFFT& AudioBufferFFT::operator= (const AudioBufferFFT& other){
-    
-    if (this != &other)
-    {
-        setSize (other.getNumChannels(), other.getNumSamples(), false, false, false);
-
-        if (other.hasBeenCleared())
-        {
-            clear();
-        }
-        else
-        {
-            
-            for (int i = 0; i < getNumChannels(); ++i)
-                FloatVectorOperations::copy (getWritePointer(i), other.getReadPointer(i), getNumSamples());
-        }
-        
-        readyForConvolution = other.readyForConvolution;
-        fft = other.fft;
-        convBuffer = other.convBuffer;
-        
-    }
-
-    return *this;
-    
-}
-
+/*
+ Audio Buffer in FFT domain
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "AudioBufferFFT.h"
+
+
+/** After each FFT, this function is called to allow convolution to be performed with only 4 SIMD functions calls.
+    Credits to juce_Convolution.cpp
+ */
+void AudioBufferFFT::prepareForConvolution(float *samples, int fftSize) const {
+    int FFTSizeDiv2 = fftSize / 2;
+
+    for (size_t i = 0; i < FFTSizeDiv2; i++)
+        samples[i] = samples[2 * i];
+
+    samples[FFTSizeDiv2] = 0;
+
+    for (size_t i = 1; i < FFTSizeDiv2; i++)
+        samples[i + FFTSizeDiv2] = -samples[2 * (fftSize - i) + 1];
+}
+
+/** Does the convolution operation itself only on half of the frequency domain samples.
+    Credits to juce_Convolution.cpp*/
+void AudioBufferFFT::convolutionProcessingAndAccumulate(const float *input, const float *impulse, float *output,
+                                                        int fftSize) const {
+    int FFTSizeDiv2 = fftSize / 2;
+
+    FloatVectorOperations::addWithMultiply(output, input, impulse, FFTSizeDiv2);
+    FloatVectorOperations::subtractWithMultiply(output, &(input[FFTSizeDiv2]), &(impulse[FFTSizeDiv2]), FFTSizeDiv2);
+
+    FloatVectorOperations::addWithMultiply(&(output[FFTSizeDiv2]), input, &(impulse[FFTSizeDiv2]), FFTSizeDiv2);
+    FloatVectorOperations::addWithMultiply(&(output[FFTSizeDiv2]), &(input[FFTSizeDiv2]), impulse, FFTSizeDiv2);
+
+    output[fftSize] += input[fftSize] * impulse[fftSize];
+}
+
+/** Undo the re-organization of samples from the function prepareForConvolution.
+     Then, takes the conjugate of the frequency domain first half of samples, to fill the
+     second half, so that the inverse transform will return real samples in the time domain.
+     Credits to juce_Convolution.cpp
+ */
+void AudioBufferFFT::updateSymmetricFrequencyDomainData(float *samples, int fftSize) const {
+    auto FFTSizeDiv2 = fftSize / 2;
+
+    for (size_t i = 1; i < FFTSizeDiv2; i++) {
+        samples[2 * (fftSize - i)] = samples[i];
+        samples[2 * (fftSize - i) + 1] = -samples[FFTSizeDiv2 + i];
+    }
+
+    samples[1] = 0.f;
+
+    for (size_t i = 1; i < FFTSizeDiv2; i++) {
+        samples[2 * i] = samples[2 * (fftSize - i)];
+        samples[2 * i + 1] = -samples[2 * (fftSize - i) + 1];
+    }
+}
+
+AudioBufferFFT::AudioBufferFFT(int numChannels, std::shared_ptr<dsp::FFT> &fft_) {
+    fft = fft_;
+    convBuffer = AudioBuffer<float>(1, fft->getSize() * 2);
+    setSize(numChannels, fft->getSize() * 2);
+}
+
+AudioBufferFFT::AudioBufferFFT(const AudioBuffer<float> &in_, std::shared_ptr<dsp::FFT> &fft_) {
+    fft = fft_;
+    convBuffer = AudioBuffer<float>(1, fft->getSize() * 2);
+    setSize(in_.getNumChannels(), fft->getSize() * 2);
+    setTimeSeries(in_);
+}
+
+AudioBufferFFT::AudioBufferFFT(float *const *preparedSpectra, int numChannels, std::shared_ptr<dsp::FFT> &fft_) {
+    fft = fft_;
+    setDataToReferTo(preparedSpectra, numChannels, fft->getSize() + 1);
+    readyForConvolution = true;
+}
+
+void AudioBufferFFT::reset() {
+    clear();
+    readyForConvolution = false;
+}
+
+void AudioBufferFFT::setTimeSeries(const AudioBuffer<float> &in_) {
+    jassert(fft->getSize() >= in_.getNumSamples());
+
+    clear();
+    for (int channelIdx = 0; channelIdx < jmin(getNumChannels(), in_.getNumChannels()); ++channelIdx) {
+        copyFrom(channelIdx, 0, in_, channelIdx, 0, in_.getNumSamples());
+    }
+    // perform FFT
+    for (int channelIdx = 0; channelIdx < jmin(getNumChannels(), in_.getNumChannels()); ++channelIdx) {
+        fft->performRealOnlyForwardTransform(getWritePointer(channelIdx));
+    }
+
+    readyForConvolution = false;
+}
+
+void AudioBufferFFT::setTimeSeriesForConvolution(int channel, const AudioBuffer<float> &in_) {
+    jassert(fft->getSize() >= in_.getNumSamples());
+    
+    auto samples = getWritePointer(channel);
+    if (channel < in_.getNumChannels()) {
+        FloatVectorOperations::copy(samples, in_.getReadPointer(channel), in_.getNumSamples());
+        FloatVectorOperations::clear(samples + in_.getNumSamples(), getNumSamples() - in_.getNumSamples());
+        fft->performRealOnlyForwardTransform(samples);
+        prepareForConvolution(samples, fft->getSize());
+    } else {
+        FloatVectorOperations::clear(samples, getNumSamples());
+    }
+}
+
+void AudioBufferFFT::setFrameForConvolution(int channel, const AudioBuffer<float> &history, int historyChannel,
+                                            int frameEnd, const dsp::FFT *engine) {
+    if (engine == nullptr) {
+        engine = fft.get();
+    }
+    jassert(engine->getSize() == fft->getSize());
+    const int fftSize = fft->getSize();
+    const int historySize = history.getNumSamples();
+    jassert(historySize >= fftSize);
+    
+    /** The frame wraps around the end of the history */
+    auto samples = getWritePointer(channel);
+    auto src = history.getReadPointer(historyChannel);
+    const int frameStart = (frameEnd - fftSize + historySize) % historySize;
+    const int numFirst = jmin(fftSize, historySize - frameStart);
+    FloatVectorOperations::copy(samples, src + frameStart, numFirst);
+    FloatVectorOperations::copy(samples + numFirst, src, fftSize - numFirst);
+    FloatVectorOperations::clear(samples + fftSize, getNumSamples() - fftSize);
+    engine->performRealOnlyForwardTransform(samples);
+    prepareForConvolution(samples, fftSize);
+}
+
+void AudioBufferFFT::updateSymmetricFrequency() {
+    if (readyForConvolution) {
+        for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
+            updateSymmetricFrequencyDomainData(getWritePointer(channelIdx), fft->getSize());
+        }
+        readyForConvolution = false;
+    }
+}
+
+void AudioBufferFFT::copyToTimeSeries(AudioBuffer<float> &out) {
+    updateSymmetricFrequency();
+    for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
+        convBuffer.copyFrom(0, 0, *(this), channelIdx, 0, fft->getSize() * 2);
+        fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
+        out.copyFrom(channelIdx, 0, convBuffer, 0, 0, fft->getSize());
+    }
+}
+
+void AudioBufferFFT::addToTimeSeries(AudioBuffer<float> &out) {
+    updateSymmetricFrequency();
+    for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
+        convBuffer.copyFrom(0, 0, *(this), channelIdx, 0, fft->getSize() * 2);
+        fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
+        out.addFrom(channelIdx, 0, convBuffer, 0, 0, fft->getSize());
+    }
+}
+
+void AudioBufferFFT::copyToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh) {
+    updateSymmetricFrequency();
+    convBuffer.copyFrom(0, 0, *(this), sourceCh, 0, fft->getSize() * 2);
+    fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
+    dest.copyFrom(destCh, 0, convBuffer, 0, 0, fft->getSize());
+}
+
+void AudioBufferFFT::addToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh, int destStartSample) {
+    jassert(destStartSample + fft->getSize() <= dest.getNumSamples());
+    updateSymmetricFrequency();
+    convBuffer.copyFrom(0, 0, *(this), sourceCh, 0, fft->getSize() * 2);
+    fft->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
+    dest.addFrom(destCh, destStartSample, convBuffer, 0, 0, fft->getSize());
+}
+
+const float *AudioBufferFFT::getTimeSeries(int sourceCh, const dsp::FFT *engine) {
+    if (engine == nullptr) {
+        engine = fft.get();
+    }
+    jassert(engine->getSize() == fft->getSize());
+    updateSymmetricFrequency();
+    convBuffer.copyFrom(0, 0, *(this), sourceCh, 0, fft->getSize() * 2);
+    engine->performRealOnlyInverseTransform(convBuffer.getWritePointer(0));
+    return convBuffer.getReadPointer(0);
+}
+
+void AudioBufferFFT::prepareForConvolution() {
+    if (!readyForConvolution) {
+        for (int channelIdx = 0; channelIdx < getNumChannels(); ++channelIdx) {
+            prepareForConvolution(getWritePointer(channelIdx), fft->getSize());
+        }
+        readyForConvolution = true;
+    } else {
+        // prepareForConvolution should not be called if
+        jassertfalse;
+    }
+}
+
+void AudioBufferFFT::setPreparedSpectrum(int channel, const std::complex<float> *halfSpectrum, float alpha) {
+    jassert(readyForConvolution || alpha == 1);
+    
+    alpha = jlimit(0.f, 1.f, alpha);
+    const int FFTSizeDiv2 = fft->getSize() / 2;
+    auto samples = getWritePointer(channel);
+    
+    /** Real parts in the first half, imaginary parts in the second half, Nyquist real part at fftSize */
+    if (alpha < 1) {
+        for (auto i = 0; i < FFTSizeDiv2; i++) {
+            samples[i] = samples[i] * (1 - alpha) + halfSpectrum[i].real() * alpha;
+        }
+        for (auto i = 1; i < FFTSizeDiv2; i++) {
+            samples[FFTSizeDiv2 + i] = samples[FFTSizeDiv2 + i] * (1 - alpha) + halfSpectrum[i].imag() * alpha;
+        }
+        samples[2 * FFTSizeDiv2] = samples[2 * FFTSizeDiv2] * (1 - alpha) + halfSpectrum[FFTSizeDiv2].real() * alpha;
+    } else {
+        for (auto i = 0; i < FFTSizeDiv2; i++) {
+            samples[i] = halfSpectrum[i].real();
+        }
+        for (auto i = 1; i < FFTSizeDiv2; i++) {
+            samples[FFTSizeDiv2 + i] = halfSpectrum[i].imag();
+        }
+        samples[2 * FFTSizeDiv2] = halfSpectrum[FFTSizeDiv2].real();
+    }
+    samples[FFTSizeDiv2] = 0;
+    FloatVectorOperations::clear(samples + 2 * FFTSizeDiv2 + 1, getNumSamples() - 2 * FFTSizeDiv2 - 1);
+    
+    readyForConvolution = true;
+}
+
+void AudioBufferFFT::decimateFrequency(const AudioBufferFFT &src) {
+    jassert(src.isReadyForConvolution());
+    jassert(src.getFftSize() % getFftSize() == 0);
+    jassert(src.getNumChannels() <= getNumChannels());
+    
+    const int ratio = src.getFftSize() / getFftSize();
+    const int FFTSizeDiv2 = getFftSize() / 2;
+    const int srcFFTSizeDiv2 = src.getFftSize() / 2;
+    
+    for (int channelIdx = 0; channelIdx < src.getNumChannels(); ++channelIdx) {
+        auto srcSamples = src.getReadPointer(channelIdx);
+        auto samples = getWritePointer(channelIdx);
+        /** Real parts in the first half, imaginary parts in the second half, Nyquist real part at fftSize */
+        for (auto i = 0; i < FFTSizeDiv2; i++) {
+            samples[i] = srcSamples[i * ratio];
+            samples[FFTSizeDiv2 + i] = srcSamples[srcFFTSizeDiv2 + i * ratio];
+        }
+        samples[2 * FFTSizeDiv2] = srcSamples[2 * srcFFTSizeDiv2];
+        FloatVectorOperations::clear(samples + 2 * FFTSizeDiv2 + 1, getNumSamples() - 2 * FFTSizeDiv2 - 1);
+    }
+    for (int channelIdx = src.getNumChannels(); channelIdx < getNumChannels(); ++channelIdx) {
+        clear(channelIdx, 0, getNumSamples());
+    }
+    
+    readyForConvolution = true;
+}
+
+void AudioBufferFFT::convolveAndAdd(int outputChannel, const AudioBufferFFT &in_, int inChannel, const AudioBufferFFT &filter_,
+                              int filterChannel) {
+
+    jassert(in_.isReadyForConvolution());
+    jassert(filter_.isReadyForConvolution());
+
+    convolutionProcessingAndAccumulate(in_.getReadPointer(inChannel), filter_.getReadPointer(filterChannel),
+                                       getWritePointer(outputChannel), fft->getSize());
+
+    readyForConvolution = true;
+}
+
+void AudioBufferFFT::convolve(int outputChannel, const AudioBufferFFT &in_, int inChannel, const AudioBufferFFT &filter_,
+                              int filterChannel) {
+
+    clear(outputChannel, 0, getNumSamples());
+    convolveAndAdd(outputChannel, in_, inChannel, filter_, filterChannel);
+}
+
+void AudioBufferFFT::convolveAndSum(int outputChannel, const AudioBufferFFT &in_, const AudioBufferFFT &filter_,
+                                    const BigInteger &channels, bool accumulate) {
+    
+    if (!accumulate) {
+        clear(outputChannel, 0, getNumSamples());
+    }
+    for (auto chIdx = channels.findNextSetBit(0); chIdx >= 0; chIdx = channels.findNextSetBit(chIdx + 1)) {
+        convolveAndAdd(outputChannel, in_, chIdx, filter_, chIdx);
+    }
+    readyForConvolution = true;
+}
+
+AudioBufferFFT& AudioBufferFFT::operator= (const AudioBufferFFT& other){
+    
+    if (this != &other)
+    {
+        setSize (other.getNumChannels(), other.getNumSamples(), false, false, false);
+
+        if (other.hasBeenCleared())
+        {
+            clear();
+        }
+        else
+        {
+            
+            for (int i = 0; i < getNumChannels(); ++i)
+                FloatVectorOperations::copy (getWritePointer(i), other.getReadPointer(i), getNumSamples());
+        }
+        
+        readyForConvolution = other.readyForConvolution;
+        fft = other.fft;
+        convBuffer = other.convBuffer;
+        
+    }
+
+    return *this;
+    
+}
+
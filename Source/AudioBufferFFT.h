@@ -1,57 +1,201 @@
-/*
- Audio Buffer in FFT domain
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
-*/
-
-#pragma once
-
-#include "../JuceLibraryCode/JuceHeader.h"
-
-class AudioBufferFFT : public AudioBuffer<float> {
-
-public:
-    AudioBufferFFT() {};
-
-    AudioBufferFFT(int numChannels, std::shared_ptr<dsp::FFT> &);
-
-    AudioBufferFFT(const AudioBuffer<float> &, std::shared_ptr<dsp::FFT> &);
-
-    void reset();
-
-    void setTimeSeries(const AudioBuffer<float> &);
-
-    void copyToTimeSeries(AudioBuffer<float> &);
-
-    void copyToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh);
-
-    void addToTimeSeries(AudioBuffer<float> &);
-
-    void addToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh);
-
-    void
-    convolve(int outputChannel, const AudioBufferFFT &in_, int inChannel, AudioBufferFFT &filter_, int filterChannel);
-    
-    void
-    convolveAndAdd(int outputChannel, const AudioBufferFFT &in_, int inChannel, AudioBufferFFT &filter_, int filterChannel);
-    
-    void prepareForConvolution();
-    
-    void updateSymmetricFrequency();
-
-    bool isReadyForConvolution() const { return readyForConvolution; };
-    
-    AudioBufferFFT& operator= (const AudioBufferFFT& other);
-
-private:
-    AudioBuffer<float> convBuffer;
-    std::shared_ptr<dsp::FFT> fft;
-    bool readyForConvolution = false;
-
-    void prepareForConvolution(float *samples, int fftSize) const;
-    void convolutionProcessingAndAccumulate(const float *input, const float *impulse, float *output, int fftSize) const;
-    void updateSymmetricFrequencyDomainData(float *samples, int fftSize) const;
-
-};
-
+/*
+ Audio Buffer in FFT domain
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class AudioBufferFFT : public AudioBuffer<float> {
+
+public:
+    AudioBufferFFT() {};
+
+    AudioBufferFFT(int numChannels, std::shared_ptr<dsp::FFT> &);
+
+    AudioBufferFFT(const AudioBuffer<float> &, std::shared_ptr<dsp::FFT> &);
+    
+    /** Refer to spectra ready for convolution held in external memory, without copying them.
+     
+     Each channel holds at least getFftSize()+1 floats, in the layout used for convolution. The memory must outlive the buffer.
+     The buffer must only be read, e.g. as the filter of a convolution.
+     */
+    AudioBufferFFT(float *const *preparedSpectra, int numChannels, std::shared_ptr<dsp::FFT> &);
+
+    void reset();
+
+    void setTimeSeries(const AudioBuffer<float> &);
+    
+    /** Set the time series of a single channel, compute its FFT and prepare it for convolution.
+     
+     Different channels can be set concurrently. Once all the channels in use are set, call setReadyForConvolution.
+     Channels not set are left untouched and must not be used.
+     @param channel: channel to set, from the same channel of in_. Cleared if in_ has no such channel
+     @param in_: time domain input
+     */
+    void setTimeSeriesForConvolution(int channel, const AudioBuffer<float> &in_);
+    
+    /** Set a channel from the last getFftSize() samples of a circular buffer, compute its FFT and prepare it for convolution.
+     
+     Frame for overlap and save. Different channels can be set concurrently, as with setTimeSeriesForConvolution.
+     @param channel: channel to set
+     @param history: circular buffer, with at least getFftSize() samples
+     @param historyChannel: channel of history to read
+     @param frameEnd: sample of history following the last sample of the frame
+     @param engine: FFT of the same size to use instead of the one of the buffer, nullptr for the one of the buffer.
+     JUCE FFT engines may lock while transforming, threads running concurrently should use one each
+     */
+    void setFrameForConvolution(int channel, const AudioBuffer<float> &history, int historyChannel, int frameEnd,
+                                const dsp::FFT *engine = nullptr);
+
+    void copyToTimeSeries(AudioBuffer<float> &);
+
+    void copyToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh);
+
+    void addToTimeSeries(AudioBuffer<float> &);
+
+    void addToTimeSeries(int sourceCh, AudioBuffer<float> &dest, int destCh, int destStartSample = 0);
+    
+    /** Compute the time series of a channel with an inverse FFT.
+     
+     @param engine: FFT of the same size to use instead of the one of the buffer, nullptr for the one of the buffer
+     @return getFftSize() samples, valid until the next call on this buffer
+     */
+    const float *getTimeSeries(int sourceCh, const dsp::FFT *engine = nullptr);
+
+    void
+    convolve(int outputChannel, const AudioBufferFFT &in_, int inChannel, const AudioBufferFFT &filter_, int filterChannel);
+    
+    void
+    convolveAndAdd(int outputChannel, const AudioBufferFFT &in_, int inChannel, const AudioBufferFFT &filter_, int filterChannel);
+    
+    /** Convolve each selected input channel with the corresponding filter channel and sum all of them in the output channel.
+     
+     Single pass on the output, the sum is computed in frequency domain and a single inverse FFT is then needed.
+     @param outputChannel: destination channel
+     @param in_: input buffer, ready for convolution
+     @param filter_: filter buffer, ready for convolution
+     @param channels: channels to sum. Channels not selected are not read.
+     @param accumulate: add to the output channel instead of overwriting it
+     */
+    void convolveAndSum(int outputChannel, const AudioBufferFFT &in_, const AudioBufferFFT &filter_, const BigInteger &channels,
+                        bool accumulate = false);
+    
+    /** Convolve each selected input channel with the corresponding filter channel and sum all of them in the output channel.
+     
+     Maximum number of channels known at compile time. Bins are processed in small tiles, the partial sums of all the channels
+     stay in local accumulators and each output bin is stored once.
+     */
+    template<int NumChannels>
+    void convolveAndSum(int outputChannel, const AudioBufferFFT &in_, const AudioBufferFFT &filter_, const BigInteger &channels,
+                        bool accumulate = false);
+    
+    void prepareForConvolution();
+    
+    /** Mark the buffer as ready for convolution, after setTimeSeriesForConvolution or after copying spectra from another buffer */
+    void setReadyForConvolution() { readyForConvolution = true; };
+    
+    /** Set a channel from its non-negative frequencies, directly in the layout used for convolution.
+     
+     Marks the buffer as ready for convolution: all the channels are expected to be set this way.
+     @param channel: destination channel
+     @param halfSpectrum: fftSize/2+1 complex frequency bins
+     @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+     */
+    void setPreparedSpectrum(int channel, const std::complex<float> *halfSpectrum, float alpha = 1);
+    
+    /** Set all the channels from a buffer ready for convolution with a larger FFT size, taking one every getFftSize()/src.getFftSize() frequency bins.
+     
+     Exact when the time domain signals are not longer than the FFT size of this buffer.
+     @param src: source buffer, ready for convolution, with an FFT size multiple of the FFT size of this buffer
+     */
+    void decimateFrequency(const AudioBufferFFT &src);
+    
+    void updateSymmetricFrequency();
+    
+    int getFftSize() const { return fft->getSize(); };
+
+    bool isReadyForConvolution() const { return readyForConvolution; };
+    
+    AudioBufferFFT& operator= (const AudioBufferFFT& other);
+
+private:
+    AudioBuffer<float> convBuffer;
+    std::shared_ptr<dsp::FFT> fft;
+    bool readyForConvolution = false;
+
+    void prepareForConvolution(float *samples, int fftSize) const;
+    void convolutionProcessingAndAccumulate(const float *input, const float *impulse, float *output, int fftSize) const;
+    void updateSymmetricFrequencyDomainData(float *samples, int fftSize) const;
+    
+    /** Number of bins accumulated together by convolveAndSum */
+    static const int sumTileSize = 16;
+
+};
+
+template<int NumChannels>
+void AudioBufferFFT::convolveAndSum(int outputChannel, const AudioBufferFFT &in_, const AudioBufferFFT &filter_,
+                                    const BigInteger &channels, bool accumulate) {
+    
+    jassert(in_.isReadyForConvolution());
+    jassert(filter_.isReadyForConvolution());
+    jassert(in_.getNumChannels() >= NumChannels);
+    jassert(filter_.getNumChannels() >= NumChannels);
+    jassert(channels.getHighestBit() < NumChannels);
+    
+    const int fftSize = fft->getSize();
+    const int FFTSizeDiv2 = fftSize / 2;
+    jassert(FFTSizeDiv2 % sumTileSize == 0);
+    
+    /** Gather the selected channels */
+    const float *in[NumChannels];
+    const float *filter[NumChannels];
+    int numChannels = 0;
+    float nyquist = 0;
+    for (auto chIdx = channels.findNextSetBit(0); chIdx >= 0; chIdx = channels.findNextSetBit(chIdx + 1)) {
+        in[numChannels] = in_.getReadPointer(chIdx);
+        filter[numChannels] = filter_.getReadPointer(chIdx);
+        nyquist += in[numChannels][fftSize] * filter[numChannels][fftSize];
+        numChannels++;
+    }
+    
+    auto output = getWritePointer(outputChannel);
+    for (auto offset = 0; offset < FFTSizeDiv2; offset += sumTileSize) {
+        float accRe[sumTileSize] = {};
+        float accIm[sumTileSize] = {};
+        /** Complex multiply and accumulate of all the selected channels */
+        for (auto chIdx = 0; chIdx < numChannels; chIdx++) {
+            const float *JUCE_RESTRICT inRe = in[chIdx] + offset;
+            const float *JUCE_RESTRICT inIm = in[chIdx] + FFTSizeDiv2 + offset;
+            const float *JUCE_RESTRICT filterRe = filter[chIdx] + offset;
+            const float *JUCE_RESTRICT filterIm = filter[chIdx] + FFTSizeDiv2 + offset;
+            for (auto i = 0; i < sumTileSize; i++) {
+                accRe[i] += inRe[i] * filterRe[i] - inIm[i] * filterIm[i];
+                accIm[i] += inRe[i] * filterIm[i] + inIm[i] * filterRe[i];
+            }
+        }
+        if (accumulate) {
+            for (auto i = 0; i < sumTileSize; i++) {
+                output[offset + i] += accRe[i];
+                output[FFTSizeDiv2 + offset + i] += accIm[i];
+            }
+        } else {
+            for (auto i = 0; i < sumTileSize; i++) {
+                output[offset + i] = accRe[i];
+                output[FFTSizeDiv2 + offset + i] = accIm[i];
+            }
+        }
+    }
+    if (accumulate) {
+        output[fftSize] += nyquist;
+    } else {
+        FloatVectorOperations::clear(output + 2 * FFTSizeDiv2 + 1, getNumSamples() - 2 * FFTSizeDiv2 - 1);
+        output[fftSize] = nyquist;
+    }
+    
+    readyForConvolution = true;
+}
+
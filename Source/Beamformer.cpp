@@ -1,304 +1,991 @@
-/*
- Beamforming processing class
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
- */
-
-#include "Beamformer.h"
-
-#define NUM_DOAX 25
-#define NUM_DOAY 9
-
-BeamformerDoa::BeamformerDoa(Beamformer &b,
-                             int numDoaHor_,
-                             int numDoaVer_,
-                             float sampleRate_,
-                             int numActiveInputChannels,
-                             int firLen,
-                             float expectedRate,
-                             std::shared_ptr<dsp::FFT> fft_) : Thread("DOA"), beamformer(b) {
-    
-    numDoaHor = numDoaHor_;
-    numDoaVer = numDoaVer_;
-    fft = fft_;
-    sampleRate = sampleRate_;
-    doaUpdateFrequency = expectedRate;
-    
-    /** Initialize levels and FIR */
-    doaLevels.resize(numDoaVer,numDoaHor);
-    doaLevels.setConstant(-100);
-    newDoaLevels.resize(numDoaVer,numDoaHor);
-    newDoaLevels.setConstant(-100);
-    doaFirFFT.resize(numDoaHor*numDoaVer);
-    
-    /** Time constants */
-    alpha = 1 - exp(-(1/doaUpdateFrequency) / timeConst);
-    
-    /** Allocate inputBuffer */
-    inputBuffer = AudioBufferFFT(numActiveInputChannels, fft);
-    
-    /** Allocate convolution buffer */
-    convolutionBuffer = AudioBufferFFT(1, fft);
-    
-    /* Determine frequency bins for energy average */
-    lowFreqIdx = lowFreq/sampleRate*fft->getSize();
-    numFreqBins = highFreq/sampleRate*fft->getSize() - lowFreqIdx;
-    
-    /** Compute FIR for DOA estimation */
-    AudioBuffer<float> tmpFir(numActiveInputChannels, firLen);
-    BeamParameters tmpBeamParams{0,0,0};
-    for (auto vDirIdx = 0; vDirIdx < numDoaVer; vDirIdx++) {
-        if (numDoaVer > 1){
-            tmpBeamParams.doaY = -1 + (2. / (numDoaVer - 1) * vDirIdx);
-        }
-        for (auto hDirIdx = 0; hDirIdx < numDoaHor; hDirIdx++) {
-            tmpBeamParams.doaX = -1 + (2. / (numDoaHor - 1) * hDirIdx);
-            b.getFir(tmpFir, tmpBeamParams, 1);
-            auto dirIdx = vDirIdx * numDoaHor + hDirIdx;
-            doaFirFFT[dirIdx] = AudioBufferFFT(numActiveInputChannels, fft);
-            doaFirFFT[dirIdx].setTimeSeries(tmpFir);
-            doaFirFFT[dirIdx].prepareForConvolution();
-        }
-    }
-}
-
-void BeamformerDoa::run() {
-    
-    while (!threadShouldExit()){
-        
-        /* Wait for previous doa to be consumed before computing a new one */
-        while (!threadShouldExit() && beamformer.isDoaOutputBufferNew())
-            sleep(5);
-        if (threadShouldExit())
-            return;
-            
-        const auto startTick = Time::getHighResolutionTicks();
-        
-        beamformer.getDoaInputBuffer(inputBuffer);
-        
-        /** Compute DOA levels */
-        for (auto vDirIdx = 0; vDirIdx < numDoaVer; vDirIdx++) {
-            for (auto hDirIdx = 0; hDirIdx < numDoaHor; hDirIdx++) {
-                auto dirIdx = vDirIdx * numDoaHor + hDirIdx;
-                
-                convolutionBuffer.clear();
-                for (auto inCh = 0; inCh < inputBuffer.getNumChannels(); inCh++) {
-                    /** Convolve inputs and DOA FIR and sum*/
-                    convolutionBuffer.convolveAndAdd(0, inputBuffer, inCh, doaFirFFT[dirIdx], inCh);
-                }
-                
-                /** Back to regular FFT data */
-                convolutionBuffer.updateSymmetricFrequency();
-                
-                std::complex<float>* cplxData = (std::complex<float>*)convolutionBuffer.getReadPointer(0);
-                Eigen::Map<CplxVec> doaBeamMap(cplxData,convolutionBuffer.getNumSamples()/2);
-
-                const float dirEnergy = doaBeamMap.segment(lowFreqIdx,numFreqBins).array().abs().sum()/float(numFreqBins);
-                const float dirEnergyDb = Decibels::gainToDecibels(dirEnergy);
-                newDoaLevels(vDirIdx,hDirIdx) = dirEnergyDb;
-            }
-        }
-        doaLevels = (doaLevels * (1 - alpha)) + (newDoaLevels * alpha);
-        beamformer.setDoaEnergy(doaLevels);
-        
-        const auto endTick = Time::getHighResolutionTicks();
-        const float elapsedTime = Time::highResolutionTicksToSeconds(endTick-startTick);
-        const float expectedPeriod = 1.f/doaUpdateFrequency;
-        const float sleepTime = expectedPeriod-elapsedTime;
-        if (sleepTime > 0){
-            sleep(expectedPeriod-elapsedTime);
-        }else{
-            //TODO: can't keep up, reduce complexity
-        }
-        
-    }
-}
-
-BeamformerDoa::~BeamformerDoa(){
-    
-}
-
-// ==============================================================================
-Beamformer::Beamformer(int numBeams_, MicConfig mic, double sampleRate_, int maximumExpectedSamplesPerBlock_,float doaRefreshRate) {
-    
-    numBeams = numBeams_;
-    numDoaVer = isLinearArray(mic) ? 1 : NUM_DOAY;
-    numDoaHor = NUM_DOAX;
-    micConfig = mic;
-    sampleRate = sampleRate_;
-    maximumExpectedSamplesPerBlock = maximumExpectedSamplesPerBlock_;
-    
-    /** Alpha for FIR update */
-    alpha = 1 - exp(-(maximumExpectedSamplesPerBlock / sampleRate) / firUpdateTimeConst);
-    
-    firIR.resize(numBeams);
-    firFFT.resize(numBeams);
-    
-    /** Distance between microphones in eSticks*/
-    const float micDistX = 0.03;
-    const float micDistY = 0.03;
-    
-    /** Determine configuration parameters */
-    switch (micConfig) {
-        case ULA_1ESTICK:
-            numMic = 16;
-            numRows = 1;
-            break;
-        case ULA_2ESTICK:
-            numMic = 32;
-            numRows = 1;
-            break;
-        case URA_2ESTICK:
-            numMic = 32;
-            numRows = 2;
-            break;
-        case ULA_3ESTICK:
-            numMic = 48;
-            numRows = 1;
-            break;
-        case URA_3ESTICK:
-            numMic = 48;
-            numRows = 3;
-            break;
-        case ULA_4ESTICK:
-            numMic = 64;
-            numRows = 1;
-            break;
-        case URA_4ESTICK:
-            numMic = 64;
-            numRows = 4;
-            break;
-        case URA_2x2ESTICK:
-            numMic = 64;
-            numRows = 2;
-            break;
-    }
-    alg = std::make_unique<DAS::FarfieldURA>(micDistX, micDistY, numMic, numRows, sampleRate, soundspeed);
-    
-    firLen = alg->getFirLen();
-    
-    /** Create shared FFT object */
-    fft = std::make_shared<juce::dsp::FFT>(ceil(log2(firLen + maximumExpectedSamplesPerBlock - 1)));
-    
-    /** Allocate FIR filters */
-    for (auto &f : firIR) {
-        f = AudioBuffer<float>(numMic, firLen);
-        f.clear();
-    }
-    for (auto &f : firFFT) {
-        f = AudioBufferFFT(numMic, fft);
-        f.clear();
-    }
-    
-    /** Allocate input buffers */
-    inputBuffer = AudioBufferFFT(numMic, fft);
-    
-    /** Allocate convolution buffer */
-    convolutionBuffer = AudioBufferFFT(1, fft);
-    
-    /** Allocate beam output buffer */
-    beamBuffer.setSize(numBeams, convolutionBuffer.getNumSamples() / 2);
-    beamBuffer.clear();
-    
-    /** Allocate DOA input buffer */
-    doaInputBuffer = AudioBufferFFT(numMic, fft);
-    doaInputBuffer.prepareForConvolution();
-    
-    /** Prepare and start DOA thread */
-    doaThread = std::make_unique<BeamformerDoa>(*this, numDoaHor, numDoaVer, sampleRate, numMic, firLen, doaRefreshRate, fft);
-    doaThread->startThread();
-    
-}
-
-Beamformer::~Beamformer() {
-    doaThread->stopThread(3000);
-}
-
-MicConfig Beamformer::getMicConfig() const {
-    return micConfig;
-}
-
-
-void Beamformer::setBeamParameters(int beamIdx, const BeamParameters &beamParams) {
-    if (alg == nullptr)
-        return;
-    alg->getFir(firIR[beamIdx], beamParams, alpha);
-    firFFT[beamIdx].setTimeSeries(firIR[beamIdx]);
-    firFFT[beamIdx].prepareForConvolution();
-}
-
-void Beamformer::processBlock(const AudioBuffer<float> &inBuffer) {
-    
-    /** Compute inputs FFT */
-    inputBuffer.setTimeSeries(inBuffer);
-    inputBuffer.prepareForConvolution();
-    
-    if (!doaInputBufferNew){
-        GenericScopedLock<SpinLock> lock(doaInputBufferLock);
-        doaInputBuffer = inputBuffer;
-        doaInputBufferNew = true;
-    }
-    
-    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
-        for (auto inCh = 0; inCh < inputBuffer.getNumChannels(); inCh++) {
-            /** Convolve inputs and FIR */
-            convolutionBuffer.convolve(0, inputBuffer, inCh, firFFT[beamIdx], inCh);
-            /** Overlap and add of convolutionBuffer into beamBuffer */
-            convolutionBuffer.addToTimeSeries(0, beamBuffer, beamIdx);
-        }
-    }
-    
-}
-
-void Beamformer::getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha) const {
-    alg->getFir(fir, params, alpha);
-}
-
-void Beamformer::getDoaInputBuffer(AudioBufferFFT &dst) {
-    GenericScopedLock<SpinLock> lock(doaInputBufferLock);
-    dst = doaInputBuffer;
-    doaInputBufferNew = false;
-}
-
-void Beamformer::getBeams(AudioBuffer<float> &outBuffer) {
-    jassert(outBuffer.getNumChannels() == numBeams);
-    auto numSplsOut = outBuffer.getNumSamples();
-    auto numSplsShift = beamBuffer.getNumSamples() - numSplsOut;
-    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
-        /** Copy beamBuffer to outBuffer */
-        outBuffer.copyFrom(beamIdx, 0, beamBuffer, beamIdx, 0, numSplsOut);
-        /** Shift beamBuffer */
-        FloatVectorOperations::copy(beamBuffer.getWritePointer(beamIdx),
-                                    beamBuffer.getReadPointer(beamIdx) + numSplsOut, numSplsShift);
-        beamBuffer.clear(beamIdx, numSplsShift, beamBuffer.getNumSamples() - numSplsShift);
-    }
-}
-
-void Beamformer::setDoaEnergy(const Mtx &energy) {
-    GenericScopedLock<SpinLock> lock(doaLock);
-    doaLevels = energy;
-    doaOutputBufferNew = true;
-}
-
-void Beamformer::getDoaEnergy(Mtx &outDoaLevels) {
-    GenericScopedLock<SpinLock> lock(doaLock);
-    outDoaLevels = doaLevels;
-    doaOutputBufferNew = false;
-}
-
-MemoryBlock Beamformer::getDoaEnergy(){
-    GenericScopedLock<SpinLock> lock(doaLock);
-    
-    MemoryBlock mb(doaLevels.size()*sizeof(float)+2);
-    mb[0] = (uint8)doaLevels.rows();
-    mb[1] = (uint8)doaLevels.cols();
-    mb.copyFrom(doaLevels.data(), 2, doaLevels.size()*sizeof(float));
-    
-    doaOutputBufferNew = false;
-    return mb;
-}
-
-bool Beamformer::isDoaOutputBufferNew() const{
-    return doaOutputBufferNew;
-}
+/*
+ Beamforming processing class
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+ */
+
+#include "Beamformer.h"
+
+#define NUM_DOAX 25
+#define NUM_DOAY 9
+
+BeamformerDoa::BeamformerDoa(Beamformer &b,
+                             int numDoaHor_,
+                             int numDoaVer_,
+                             float sampleRate_,
+                             int numActiveInputChannels,
+                             float expectedRate,
+                             std::shared_ptr<dsp::FFT> fft_) : Thread("DOA"), beamformer(b) {
+    
+    numDoaHor = numDoaHor_;
+    numDoaVer = numDoaVer_;
+    fft = fft_;
+    sampleRate = sampleRate_;
+    doaUpdateFrequency = expectedRate;
+    
+    /** Initialize levels and FIR */
+    doaLevels.resize(numDoaVer,numDoaHor);
+    doaLevels.setConstant(-100);
+    newDoaLevels.resize(numDoaVer,numDoaHor);
+    newDoaLevels.setConstant(-100);
+    
+    /** Time constants */
+    alpha = 1 - exp(-(1/doaUpdateFrequency) / timeConst);
+    
+    /** Allocate inputBuffer */
+    inputBuffer = AudioBufferFFT(numActiveInputChannels, fft);
+    doaMics.setRange(0, numActiveInputChannels, true);
+    
+    /** Allocate convolution buffer */
+    convolutionBuffer = AudioBufferFFT(1, fft);
+    
+    /* Determine frequency bins for energy average */
+    lowFreqIdx = lowFreq/sampleRate*fft->getSize();
+    numFreqBins = highFreq/sampleRate*fft->getSize() - lowFreqIdx;
+}
+
+void BeamformerDoa::designFir(int dirIdx, AudioBufferFFT &fir) {
+    const auto vDirIdx = dirIdx / numDoaHor;
+    const auto hDirIdx = dirIdx % numDoaHor;
+    BeamParameters dirParams{0, 0, 0};
+    dirParams.doaX = -1 + (2. / (numDoaHor - 1) * hDirIdx);
+    if (numDoaVer > 1) {
+        dirParams.doaY = -1 + (2. / (numDoaVer - 1) * vDirIdx);
+    }
+    fir = AudioBufferFFT(inputBuffer.getNumChannels(), fft);
+    beamformer.getFirFFT(fir, dirParams, 1);
+}
+
+bool BeamformerDoa::prepareFirs() {
+    
+    /** FIR for DOA estimation, shared by the beamformers with the same configuration */
+    static SharedCache<std::tuple<int, float, int, int, int, int>, const FilterBank> doaFirCache;
+    const int numChannels = inputBuffer.getNumChannels();
+    const auto key = std::make_tuple(int(beamformer.getMicConfig()), sampleRate, fft->getSize(), numDoaHor, numDoaVer,
+                                     numChannels);
+    doaFirFFT = doaFirCache.find(key);
+    if (doaFirFFT != nullptr)
+        return true;
+    
+    /** Load the filters saved by a previous run. The name identifies the design and the DOA grid, a change of either
+     saves a new bank
+     */
+    const int numDirs = numDoaHor * numDoaVer;
+    const auto bankName = "doa" + String(doaGridVersion) + "_" + beamformer.getDesignId() + "_" +
+                          String(fft->getSize()) + "_" + String(numDoaHor) + "x" + String(numDoaVer) + "_" +
+                          String(numChannels);
+    auto firs = loadFilterBank(bankName, numDirs, numChannels, fft);
+    
+    if (firs == nullptr) {
+        /** Design the filters outside of the cache lock, one direction at a time, on this thread and on helper threads */
+        auto newFirs = std::make_shared<FilterBank>(numDirs);
+        std::atomic<int> nextDirIdx {0};
+        auto designFirs = [&]() {
+            for (int dirIdx = nextDirIdx++; dirIdx < numDirs && !threadShouldExit(); dirIdx = nextDirIdx++) {
+                designFir(dirIdx, (*newFirs)[dirIdx]);
+            }
+        };
+        {
+            const int numHelpers = jmin(numDirs, SystemStats::getNumCpus()) - 1;
+            std::unique_ptr<ThreadPool> helpers;
+            if (numHelpers > 0) {
+                helpers = std::make_unique<ThreadPool>(numHelpers);
+                for (auto helperIdx = 0; helperIdx < numHelpers; helperIdx++) {
+                    helpers->addJob(designFirs);
+                }
+            }
+            designFirs();
+            /** Wait for the directions the helpers are still designing */
+            if (helpers != nullptr) {
+                helpers->removeAllJobs(false, -1);
+            }
+        }
+        if (threadShouldExit())
+            return false;
+        
+        saveFilterBank(bankName, *newFirs);
+        firs = newFirs;
+    }
+    
+    /** Share the filters. If another beamformer prepared them meanwhile, use its ones */
+    doaFirFFT = doaFirCache.get(key, [&firs]() { return firs; });
+    return true;
+}
+
+void BeamformerDoa::run() {
+    
+    /** The DOA warms up while the filters are designed */
+    if (!prepareFirs())
+        return;
+    
+    while (!threadShouldExit()){
+        
+        /* Wait for previous doa to be consumed before computing a new one */
+        while (!threadShouldExit() && beamformer.isDoaOutputBufferNew())
+            sleep(5);
+        if (threadShouldExit())
+            return;
+            
+        const bool counted = counters.prepare();
+        const auto startEvents = counted ? counters.read() : PerfCounters::Reading();
+        const auto startTick = Time::getHighResolutionTicks();
+        auto &trace = TraceRecorder::getInstance();
+        const bool traced = trace.isEnabled();
+        if (traced)
+            trace.begin("doaCycle");
+        
+        beamformer.getDoaInputBuffer(inputBuffer);
+        
+        /** Compute DOA levels */
+        for (auto vDirIdx = 0; vDirIdx < numDoaVer; vDirIdx++) {
+            for (auto hDirIdx = 0; hDirIdx < numDoaHor; hDirIdx++) {
+                auto dirIdx = vDirIdx * numDoaHor + hDirIdx;
+                
+                /** Convolve inputs and DOA FIR and sum*/
+                beamformer.convolveAndSum(convolutionBuffer, 0, inputBuffer, (*doaFirFFT)[dirIdx], doaMics);
+                
+                /** Back to regular FFT data */
+                convolutionBuffer.updateSymmetricFrequency();
+                
+                std::complex<float>* cplxData = (std::complex<float>*)convolutionBuffer.getReadPointer(0);
+                Eigen::Map<CplxVec> doaBeamMap(cplxData,convolutionBuffer.getNumSamples()/2);
+
+                const float dirEnergy = doaBeamMap.segment(lowFreqIdx,numFreqBins).array().abs().sum()/float(numFreqBins);
+                const float dirEnergyDb = Decibels::gainToDecibels(dirEnergy);
+                newDoaLevels(vDirIdx,hDirIdx) = dirEnergyDb;
+            }
+        }
+        doaLevels = (doaLevels * (1 - alpha)) + (newDoaLevels * alpha);
+        beamformer.setDoaEnergy(doaLevels);
+        beamformer.getProfiler().record(StageProfiler::doaCycle, startTick, 1. / doaUpdateFrequency);
+        if (counted) {
+            beamformer.getProfiler().recordEvents(StageProfiler::doaCycle, counters.read() - startEvents);
+        }
+        if (traced)
+            trace.end("doaCycle");
+        
+        const auto endTick = Time::getHighResolutionTicks();
+        const float elapsedTime = Time::highResolutionTicksToSeconds(endTick-startTick);
+        const float expectedPeriod = 1.f/doaUpdateFrequency;
+        const float sleepTime = expectedPeriod-elapsedTime;
+        if (sleepTime > 0){
+            wait(roundToInt(sleepTime * 1000));
+        }else{
+            //TODO: can't keep up, reduce complexity
+        }
+        
+    }
+}
+
+BeamformerDoa::~BeamformerDoa(){
+    
+}
+
+// ==============================================================================
+static bool isSameBeam(const BeamParameters &a, const BeamParameters &b) {
+    return a.doaX == b.doaX && a.doaY == b.doaY && a.width == b.width;
+}
+
+BeamformerFirDesigner::BeamformerFirDesigner(Beamformer &b,
+                                             int numBeams_,
+                                             int numMic_,
+                                             std::shared_ptr<dsp::FFT> fft_) : Thread("FIR designer"), beamformer(b) {
+    
+    numBeams = numBeams_;
+    numMic = numMic_;
+    fft = fft_;
+    
+    requestedParams.resize(numBeams, {0, 0, 0});
+    requested.resize(numBeams, false);
+    designed.resize(numBeams, false);
+    targetParams.resize(numBeams, {0, 0, 0});
+    converged.resize(numBeams, true);
+    lastChangeTicks.resize(numBeams, Time::getHighResolutionTicks());
+    lastDesignTicks.resize(numBeams, Time::getHighResolutionTicks());
+    
+    /** Allocate FIR filters */
+    firFFTSmoothLen.resize(numBeams, 0);
+    firFFTSmoothMics.resize(numBeams);
+    firMics.resize(numBeams * numSlots);
+    firFFTSmooth.resize(numBeams);
+    for (auto &f : firFFTSmooth) {
+        f = AudioBufferFFT(numMic, fft);
+        f.clear();
+        f.prepareForConvolution();
+    }
+    firFFT.resize(numBeams * numSlots);
+    for (auto &f : firFFT) {
+        f = AudioBufferFFT(numMic, fft);
+        f.clear();
+        f.prepareForConvolution();
+    }
+    
+    /** Initial slots assignment */
+    audioSlot.resize(numBeams, 0);
+    audioSlotDesigned.resize(numBeams, false);
+    publishedSlot = std::make_unique<std::atomic<int>[]>(numBeams);
+    designSlot.resize(numBeams, 2);
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        publishedSlot[beamIdx] = 1;
+    }
+}
+
+BeamformerFirDesigner::~BeamformerFirDesigner(){
+    
+}
+
+void BeamformerFirDesigner::setBeamParameters(int beamIdx, const BeamParameters &beamParams) {
+    GenericScopedTryLock<SpinLock> lock(requestedParamsLock);
+    if (lock.isLocked()) {
+        requestedParams[beamIdx] = beamParams;
+        requested[beamIdx] = true;
+    }
+}
+
+const AudioBufferFFT &BeamformerFirDesigner::getBeamFir(int beamIdx) {
+    if (publishedSlot[beamIdx].load() & newSlotFlag) {
+        audioSlot[beamIdx] = publishedSlot[beamIdx].exchange(audioSlot[beamIdx]) & ~newSlotFlag;
+        audioSlotDesigned[beamIdx] = true;
+    }
+    return firFFT[beamIdx * numSlots + audioSlot[beamIdx]];
+}
+
+const BigInteger &BeamformerFirDesigner::getBeamMics(int beamIdx) const {
+    return firMics[beamIdx * numSlots + audioSlot[beamIdx]];
+}
+
+bool BeamformerFirDesigner::isBeamFirDesigned(int beamIdx) const {
+    return audioSlotDesigned[beamIdx];
+}
+
+bool BeamformerFirDesigner::areAllBeamsDesigned() const {
+    return numBeamsDesigned == numBeams;
+}
+
+void BeamformerFirDesigner::run() {
+    
+    while (!threadShouldExit()) {
+        
+        const auto nowTicks = Time::getHighResolutionTicks();
+        
+        /** Collect the requested parameters */
+        {
+            GenericScopedLock<SpinLock> lock(requestedParamsLock);
+            for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+                if (requested[beamIdx] &&
+                    (!designed[beamIdx] || !isSameBeam(requestedParams[beamIdx], targetParams[beamIdx]))) {
+                    targetParams[beamIdx] = requestedParams[beamIdx];
+                    lastChangeTicks[beamIdx] = nowTicks;
+                    converged[beamIdx] = false;
+                }
+            }
+        }
+        
+        /** Design and publish the filters still converging */
+        for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+            if (converged[beamIdx])
+                continue;
+            
+            /** The first design has nothing to converge from and is exact */
+            const bool settled = !designed[beamIdx] ||
+                                 Time::highResolutionTicksToSeconds(nowTicks - lastChangeTicks[beamIdx]) > firSettleTime;
+            const float elapsedTime = Time::highResolutionTicksToSeconds(nowTicks - lastDesignTicks[beamIdx]);
+            const float alpha = settled ? 1 : 1 - exp(-elapsedTime / firUpdateTimeConst);
+            
+            const auto designStartTick = Time::getHighResolutionTicks();
+            TraceRecorder::Scope traceScope("firDesign");
+            beamformer.getFirFFT(firFFTSmooth[beamIdx], targetParams[beamIdx], alpha);
+            
+            /** While converging the smoothed filter spans both the previous and the target filter */
+            const int targetLen = beamformer.getFirFFTLen(targetParams[beamIdx]);
+            firFFTSmoothLen[beamIdx] = settled ? targetLen : jmax(firFFTSmoothLen[beamIdx], targetLen);
+            const auto targetMics = beamformer.getActiveMics(targetParams[beamIdx]);
+            if (settled) {
+                firFFTSmoothMics[beamIdx] = targetMics;
+            } else {
+                firFFTSmoothMics[beamIdx] |= targetMics;
+            }
+            
+            /** Publish at the smallest FFT size that fits the filter */
+            auto levelFft = beamformer.getFft(firFFTSmoothLen[beamIdx]);
+            auto &slot = firFFT[beamIdx * numSlots + designSlot[beamIdx]];
+            if (slot.getFftSize() != levelFft->getSize()) {
+                slot = AudioBufferFFT(numMic, levelFft);
+            }
+            slot.decimateFrequency(firFFTSmooth[beamIdx]);
+            firMics[beamIdx * numSlots + designSlot[beamIdx]] = firFFTSmoothMics[beamIdx];
+            designSlot[beamIdx] = publishedSlot[beamIdx].exchange(designSlot[beamIdx] | newSlotFlag) & ~newSlotFlag;
+            beamformer.getProfiler().record(StageProfiler::firDesign, designStartTick);
+            
+            lastDesignTicks[beamIdx] = nowTicks;
+            converged[beamIdx] = settled;
+            if (!designed[beamIdx]) {
+                designed[beamIdx] = true;
+                numBeamsDesigned++;
+            }
+        }
+        
+        wait(designPeriodMs);
+    }
+}
+
+// ==============================================================================
+BeamformerWorkers::Worker::Worker(BeamformerWorkers &p, int workerIdx_) : Thread("Beamformer worker " + String(workerIdx_)),
+                                                                          pool(p) {
+    workerIdx = workerIdx_;
+}
+
+void BeamformerWorkers::Worker::run() {
+    
+    auto lastBatch = pool.batch.load();
+    while (!threadShouldExit()) {
+        
+        /** Spin for a while, then sleep until a new batch is submitted */
+        const auto spinEndTicks = Time::getHighResolutionTicks() + pool.spinTicks;
+        while (pool.batch.load() == lastBatch && !threadShouldExit()) {
+            if (Time::getHighResolutionTicks() > spinEndTicks) {
+                sleeping = true;
+                if (pool.batch.load() == lastBatch) {
+                    wait(pool.sleepTimeoutMs);
+                }
+                sleeping = false;
+            }
+        }
+        
+        lastBatch = pool.batch.load();
+        TraceRecorder::Scope traceScope("workerTasks");
+        RealtimeCheck::Scope realtimeScope;
+        pool.runTasks(lastBatch, workerIdx);
+    }
+}
+
+BeamformerWorkers::BeamformerWorkers(int numThreads) {
+    
+    spinTicks = Time::secondsToHighResolutionTicks(spinTime);
+    
+    for (auto threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+        workers.push_back(std::make_unique<Worker>(*this, threadIdx + 1));
+        /** One core for each worker, the first one is left to the host. The affinity mask covers 32 cores */
+        const auto core = (threadIdx + 1) % jlimit(1, 32, SystemStats::getNumCpus());
+        workers.back()->setAffinityMask(uint32(1) << core);
+        workers.back()->startThread(Thread::realtimeAudioPriority);
+    }
+}
+
+BeamformerWorkers::~BeamformerWorkers() {
+    for (auto &w : workers) {
+        w->signalThreadShouldExit();
+        w->notify();
+    }
+    for (auto &w : workers) {
+        w->stopThread(1000);
+    }
+}
+
+int BeamformerWorkers::getNumWorkers() const {
+    return int(workers.size()) + 1;
+}
+
+void BeamformerWorkers::run(Job &job_, int numTasks_) {
+    
+    /** Publish the batch. The tasks are re-tagged first: a worker late on the previous batch that reads the new job or
+     number of tasks can't claim a task anymore. The batch index last, to start the workers
+     */
+    const uint32 newBatch = batch.load() + 1;
+    nextTask = uint64(newBatch) << 32;
+    job = &job_;
+    numTasks = numTasks_;
+    tasksDone = 0;
+    batch = newBatch;
+    
+    /** Wake up the sleeping workers */
+    for (auto &w : workers) {
+        if (w->sleeping) {
+            w->notify();
+        }
+    }
+    
+    /** Take part in the batch, then wait for the tasks claimed by the workers */
+    runTasks(newBatch, 0);
+    while (tasksDone.load() < numTasks_) {
+    }
+}
+
+void BeamformerWorkers::runTasks(uint32 batchIdx, int workerIdx) {
+    
+    /** Loaded before the tasks: if they belong to another batch, the tags don't match */
+    auto curJob = job.load();
+    const auto curNumTasks = numTasks.load();
+    
+    /** Claim tasks only while the batch is the expected one */
+    auto cur = nextTask.load();
+    while (uint32(cur >> 32) == batchIdx && int(cur & 0xffffffff) < curNumTasks) {
+        if (nextTask.compare_exchange_weak(cur, cur + 1)) {
+            curJob->runTask(int(cur & 0xffffffff), workerIdx);
+            tasksDone++;
+            cur = nextTask.load();
+        }
+    }
+}
+
+// ==============================================================================
+Beamformer::Beamformer(int numBeams_, MicConfig mic, double sampleRate_, int maximumExpectedSamplesPerBlock_,float doaRefreshRate,
+                       int numWorkers) {
+    
+    numBeams = numBeams_;
+    numDoaVer = isLinearArray(mic) ? 1 : NUM_DOAY;
+    numDoaHor = NUM_DOAX;
+    micConfig = mic;
+    sampleRate = sampleRate_;
+    maximumExpectedSamplesPerBlock = maximumExpectedSamplesPerBlock_;
+    
+    /** Distance between microphones in eSticks*/
+    const float micDistX = 0.03;
+    const float micDistY = 0.03;
+    
+    /** Determine configuration parameters and select the algorithm specialized for the configuration */
+    switch (micConfig) {
+        case ULA_1ESTICK:
+            initAlg<16, 1>(micDistX, micDistY);
+            break;
+        case ULA_2ESTICK:
+            initAlg<32, 1>(micDistX, micDistY);
+            break;
+        case URA_2ESTICK:
+            initAlg<32, 2>(micDistX, micDistY);
+            break;
+        case ULA_3ESTICK:
+            initAlg<48, 1>(micDistX, micDistY);
+            break;
+        case URA_3ESTICK:
+            initAlg<48, 3>(micDistX, micDistY);
+            break;
+        case ULA_4ESTICK:
+            initAlg<64, 1>(micDistX, micDistY);
+            break;
+        case URA_4ESTICK:
+            initAlg<64, 4>(micDistX, micDistY);
+            break;
+        case URA_2x2ESTICK:
+            initAlg<64, 2>(micDistX, micDistY);
+            break;
+    }
+    
+    firLen = alg->getMaxFirFFTLen();
+    firOutputDelay = alg->getFirFFTDelay();
+    
+    /** Create the FFT objects of this instance: JUCE FFT engines may lock while transforming, so the audio threads of
+     different instances don't share them
+     */
+    fft = std::make_shared<dsp::FFT>(int(ceil(log2(firLen + maximumExpectedSamplesPerBlock - 1))));
+    
+    /** Prepare the algorithm to design filters ready for convolution */
+    alg->prepareFirFFT(fft->getSize());
+    
+    /** Create the FFT objects for shorter filters, halving the size while a block and a filter still fit */
+    fftLevels.push_back(fft);
+    while ((fftLevels.back()->getSize() / 2 >= maximumExpectedSamplesPerBlock + 1) &&
+           (fftLevels.back()->getSize() / 2 >= minFftLevelSize)) {
+        fftLevels.push_back(std::make_shared<dsp::FFT>(roundToInt(log2(fftLevels.back()->getSize() / 2))));
+    }
+    
+    /** Allocate inputs history, inputs and beams buffers, for each FFT size */
+    inputHistory.setSize(numMic, fft->getSize());
+    inputHistory.clear();
+    sharedBlock.setSize(numMic, maximumExpectedSamplesPerBlock);
+    for (auto &levelFft : fftLevels) {
+        inputBuffers.push_back(AudioBufferFFT(numMic, levelFft));
+    }
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        for (auto &levelFft : fftLevels) {
+            beamSpectra.push_back(AudioBufferFFT(1, levelFft));
+        }
+    }
+    levelInputMics.resize(fftLevels.size());
+    sharedLevelMics.resize(fftLevels.size());
+    allMics.setRange(0, numMic, true);
+    beamFirs.resize(numBeams, nullptr);
+    beamLevels.resize(numBeams, 0);
+    
+    /** Prepare the workers, splitting the beams by eStick */
+    if (numWorkers > 0) {
+        workers = std::make_unique<BeamformerWorkers>(numWorkers);
+        for (auto micIdx = 0; micIdx < numMic; micIdx += numMicPerEstick) {
+            micGroups.push_back(BigInteger().setRange(micIdx, jmin(numMicPerEstick, numMic - micIdx), true));
+        }
+    } else {
+        micGroups.push_back(allMics);
+    }
+    inputTasks.resize(numMic * fftLevels.size());
+    beamTiles.resize(numBeams * micGroups.size());
+    workerScratch.resize(workers != nullptr ? workers->getNumWorkers() : 1);
+    for (auto workerIdx = 0; workerIdx < int(workerScratch.size()); workerIdx++) {
+        auto &scratch = workerScratch[workerIdx];
+        for (auto &levelFft : fftLevels) {
+            scratch.partialSpectra.push_back(AudioBufferFFT(numBeams, levelFft));
+            if (workerIdx > 0) {
+                scratch.levelFfts.push_back(std::make_unique<dsp::FFT>(roundToInt(log2(levelFft->getSize()))));
+            }
+        }
+        scratch.beamTouched.resize(numBeams, false);
+    }
+    
+    /** Allocate beam output buffer */
+    beamBuffer.setSize(numBeams, firOutputDelay + maximumExpectedSamplesPerBlock);
+    beamBuffer.clear();
+    
+    /** Allocate DOA input buffer */
+    doaInputBuffer = AudioBufferFFT(numMic, fft);
+    doaInputBuffer.prepareForConvolution();
+    
+    /** Silent DOA levels until the DOA warms up */
+    doaLevels.setConstant(numDoaVer, numDoaHor, -100);
+    
+    /** Prepare and start DOA thread, designing the DOA filters in background */
+    doaThread = std::make_unique<BeamformerDoa>(*this, numDoaHor, numDoaVer, sampleRate, numMic, doaRefreshRate, fft);
+    doaThread->startThread();
+    
+    /** Prepare and start FIR designer thread */
+    firDesigner = std::make_unique<BeamformerFirDesigner>(*this, numBeams, numMic, fft);
+    firDesigner->startThread();
+    
+}
+
+template<int NumMic, int NumRows>
+void Beamformer::initAlg(float micDistX, float micDistY) {
+    numMic = NumMic;
+    numRows = NumRows;
+    alg = std::make_unique<DAS::FarfieldURA>(micDistX, micDistY, numMic, numRows, sampleRate, soundspeed);
+#if EBEAMER_DYNAMIC_KERNELS
+    beamSum = nullptr;
+#else
+    beamSum = &AudioBufferFFT::convolveAndSum<NumMic>;
+#endif
+}
+
+Beamformer::~Beamformer() {
+    if (sharedInput != nullptr) {
+        sharedInput->detach(this);
+    }
+    workers.reset();
+    firDesigner->stopThread(3000);
+    doaThread->stopThread(3000);
+}
+
+MicConfig Beamformer::getMicConfig() const {
+    return micConfig;
+}
+
+int Beamformer::getNumMic(MicConfig mic) {
+    switch (mic) {
+        case ULA_1ESTICK:
+            return 16;
+        case ULA_2ESTICK:
+        case URA_2ESTICK:
+            return 32;
+        case ULA_3ESTICK:
+        case URA_3ESTICK:
+            return 48;
+        case ULA_4ESTICK:
+        case URA_4ESTICK:
+        case URA_2x2ESTICK:
+            return 64;
+    }
+    return 0;
+}
+
+int Beamformer::getMaximumExpectedSamplesPerBlock() const {
+    return maximumExpectedSamplesPerBlock;
+}
+
+int Beamformer::getNumWorkers() const {
+    /** The pool counts the calling thread too */
+    return workers != nullptr ? workers->getNumWorkers() - 1 : 0;
+}
+
+int Beamformer::getLatency() const {
+    return alg->getLatency();
+}
+
+bool Beamformer::canReuse(int numBeams_, MicConfig mic, double sampleRate_, int maximumExpectedSamplesPerBlock_) const {
+    return numBeams_ == numBeams && mic == micConfig && float(sampleRate_) == sampleRate &&
+           maximumExpectedSamplesPerBlock_ <= maximumExpectedSamplesPerBlock;
+}
+
+bool Beamformer::areBeamsDesigned() const {
+    return firDesigner->areAllBeamsDesigned();
+}
+
+bool Beamformer::areBeamsReady() const {
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        if (!firDesigner->isBeamFirDesigned(beamIdx))
+            return false;
+    }
+    return true;
+}
+
+void Beamformer::setSharedInput(std::shared_ptr<SharedInput> sharedInput_) {
+    if (sharedInput_ == sharedInput)
+        return;
+    if (sharedInput != nullptr) {
+        sharedInput->detach(this);
+    }
+    sharedInput = sharedInput_;
+    if (sharedInput != nullptr) {
+        sharedInput->prepare(numMic, maximumExpectedSamplesPerBlock, fftLevels);
+        sharedInput->attach(this, int(fftLevels.size()));
+    }
+}
+
+
+void Beamformer::setBeamParameters(int beamIdx, const BeamParameters &beamParams) {
+    firDesigner->setBeamParameters(beamIdx, beamParams);
+}
+
+void Beamformer::processBlock(const AudioBuffer<float> &inBuffer, bool publishInput) {
+    
+    jassert(inBuffer.getNumSamples() <= maximumExpectedSamplesPerBlock);
+    
+    blockSize = inBuffer.getNumSamples();
+    appendInputHistory(inBuffer, blockSize);
+    
+    const bool doaInputNeeded = isDoaInputNeeded();
+    pickUpFilters(doaInputNeeded);
+    
+    /** Also compute the spectra the other instances sharing the input requested */
+    publishInput = publishInput && sharedInput != nullptr;
+    if (sharedInput != nullptr) {
+        sharedInput->requestMics(this, levelInputMics);
+    }
+    if (publishInput) {
+        sharedInput->addRequestedMics(levelInputMics);
+    }
+    
+    /** Compute the inputs frames FFT, only for the microphones and the levels in use */
+    auto numInputTasks = 0;
+    for (auto level = 0; level < int(fftLevels.size()); level++) {
+        const auto &mics = levelInputMics[level];
+        for (auto micIdx = mics.findNextSetBit(0); micIdx >= 0; micIdx = mics.findNextSetBit(micIdx + 1)) {
+            inputTasks[numInputTasks++] = {level, micIdx};
+        }
+    }
+    runPhase(Phase::inputFFT, numInputTasks);
+    for (auto level = 0; level < int(fftLevels.size()); level++) {
+        if (!levelInputMics[level].isZero()) {
+            inputBuffers[level].setReadyForConvolution();
+        }
+    }
+    
+    if (publishInput) {
+        sharedInput->publish(inBuffer, inputBuffers, levelInputMics);
+    }
+    
+    processBeams(doaInputNeeded);
+}
+
+void Beamformer::processSharedBlock() {
+    
+    jassert(sharedInput != nullptr);
+    
+    /** Input processed by another instance, to keep the history complete in case this instance claims the next blocks */
+    blockSize = sharedInput->getBlock(sharedBlock);
+    appendInputHistory(sharedBlock, blockSize);
+    
+    const bool doaInputNeeded = isDoaInputNeeded();
+    pickUpFilters(doaInputNeeded);
+    
+    sharedInput->requestMics(this, levelInputMics);
+    
+    /** Inputs spectra computed by another instance. The microphones the publisher didn't compute, e.g. right after a
+     change of the filters of this instance, are computed from the input history */
+    auto numInputTasks = 0;
+    for (auto level = 0; level < int(fftLevels.size()); level++) {
+        const auto &mics = levelInputMics[level];
+        if (mics.isZero())
+            continue;
+        sharedInput->getSpectra(level, inputBuffers[level], sharedLevelMics[level]);
+        for (auto micIdx = mics.findNextSetBit(0); micIdx >= 0; micIdx = mics.findNextSetBit(micIdx + 1)) {
+            if (!sharedLevelMics[level][micIdx]) {
+                inputTasks[numInputTasks++] = {level, micIdx};
+            }
+        }
+    }
+    if (numInputTasks > 0) {
+        runPhase(Phase::inputFFT, numInputTasks);
+        for (auto level = 0; level < int(fftLevels.size()); level++) {
+            if (!levelInputMics[level].isZero()) {
+                inputBuffers[level].setReadyForConvolution();
+            }
+        }
+    }
+    
+    processBeams(doaInputNeeded);
+}
+
+void Beamformer::appendInputHistory(const AudioBuffer<float> &block, int numSamples) {
+    const auto historySize = inputHistory.getNumSamples();
+    const auto numFirst = jmin(numSamples, historySize - inputHistoryEnd);
+    for (auto micIdx = 0; micIdx < numMic; micIdx++) {
+        if (micIdx < block.getNumChannels()) {
+            inputHistory.copyFrom(micIdx, inputHistoryEnd, block, micIdx, 0, numFirst);
+            inputHistory.copyFrom(micIdx, 0, block, micIdx, numFirst, numSamples - numFirst);
+        } else {
+            inputHistory.clear(micIdx, inputHistoryEnd, numFirst);
+            inputHistory.clear(micIdx, 0, numSamples - numFirst);
+        }
+    }
+    inputHistoryEnd = (inputHistoryEnd + numSamples) % historySize;
+}
+
+bool Beamformer::isDoaInputNeeded() const {
+    /** With a shared input, only the DOA owner computes the DOA */
+    return !doaInputBufferNew && (sharedInput == nullptr || sharedInput->isDoaOwner(this));
+}
+
+void Beamformer::pickUpFilters(bool doaInputNeeded) {
+    /** Pick up the most recent filters, and collect the microphones they use at their FFT level */
+    std::fill(levelInputMics.begin(), levelInputMics.end(), BigInteger());
+    if (doaInputNeeded) {
+        levelInputMics[0] = allMics;
+    }
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        beamFirs[beamIdx] = &firDesigner->getBeamFir(beamIdx);
+        beamLevels[beamIdx] = getFftLevel(*beamFirs[beamIdx]);
+        levelInputMics[beamLevels[beamIdx]] |= firDesigner->getBeamMics(beamIdx);
+    }
+}
+
+void Beamformer::processBeams(bool doaInputNeeded) {
+    
+    if (doaInputNeeded){
+        GenericScopedLock<SpinLock> lock(doaInputBufferLock);
+        doaInputBuffer = inputBuffers[0];
+        doaInputBufferNew = true;
+    }
+    
+    /** Split the beams in tiles, skipping the groups of microphones not used by a beam */
+    auto numBeamTiles = 0;
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        const auto &beamMics = firDesigner->getBeamMics(beamIdx);
+        for (const auto &group : micGroups) {
+            auto &tile = beamTiles[numBeamTiles];
+            tile.beamIdx = beamIdx;
+            tile.mics = beamMics;
+            tile.mics &= group;
+            if (!tile.mics.isZero()) {
+                numBeamTiles++;
+            }
+        }
+    }
+    for (auto &scratch : workerScratch) {
+        std::fill(scratch.beamTouched.begin(), scratch.beamTouched.end(), false);
+    }
+    runPhase(Phase::beamTiles, numBeamTiles);
+    
+    /** Reduce the partial spectra and go back to time domain */
+    runPhase(Phase::beamReduce, numBeams);
+    beamBufferEnd = (beamBufferEnd + blockSize) % beamBuffer.getNumSamples();
+    
+}
+
+void Beamformer::runPhase(Phase p, int numTasks) {
+    const auto stage = p == Phase::inputFFT ? StageProfiler::inputFFT :
+                       p == Phase::beamTiles ? StageProfiler::convolution : StageProfiler::ifft;
+    TraceRecorder::Scope traceScope(p == Phase::inputFFT ? "inputFFT" :
+                                    p == Phase::beamTiles ? "convolution" : "ifft");
+    const bool counted = processCounters.prepare();
+    const auto startEvents = counted ? processCounters.read() : PerfCounters::Reading();
+    const auto startTick = Time::getHighResolutionTicks();
+    phase = p;
+    if (workers != nullptr) {
+        workers->run(*this, numTasks);
+    } else {
+        for (auto taskIdx = 0; taskIdx < numTasks; taskIdx++) {
+            runTask(taskIdx, 0);
+        }
+    }
+    
+    /** A phase overruns when it alone takes longer than the block it processes */
+    profiler.record(stage, startTick, blockSize / sampleRate);
+    if (counted) {
+        /** Events of the calling thread only, the share of the tasks run by the workers is not counted */
+        profiler.recordEvents(stage, processCounters.read() - startEvents);
+    }
+}
+
+void Beamformer::runTask(int taskIdx, int workerIdx) {
+    switch (phase) {
+        case Phase::inputFFT: {
+            const auto &task = inputTasks[taskIdx];
+            inputBuffers[task.level].setFrameForConvolution(task.micIdx, inputHistory, task.micIdx, inputHistoryEnd,
+                                                            getWorkerFft(workerIdx, task.level));
+            break;
+        }
+        case Phase::beamTiles: {
+            /** Convolve inputs and FIR, summing in frequency domain in the partial spectrum of the worker */
+            const auto &tile = beamTiles[taskIdx];
+            auto &scratch = workerScratch[workerIdx];
+            const auto level = beamLevels[tile.beamIdx];
+            convolveAndSum(scratch.partialSpectra[level], tile.beamIdx, inputBuffers[level], *beamFirs[tile.beamIdx],
+                           tile.mics, scratch.beamTouched[tile.beamIdx]);
+            scratch.beamTouched[tile.beamIdx] = true;
+            break;
+        }
+        case Phase::beamReduce: {
+            const auto beamIdx = taskIdx;
+            const auto level = beamLevels[beamIdx];
+            auto &spectrum = beamSpectra[beamIdx * fftLevels.size() + level];
+            auto numPartials = 0;
+            for (auto &scratch : workerScratch) {
+                if (scratch.beamTouched[beamIdx]) {
+                    if (numPartials++ == 0) {
+                        spectrum.copyFrom(0, 0, scratch.partialSpectra[level], beamIdx, 0, spectrum.getNumSamples());
+                    } else {
+                        spectrum.addFrom(0, 0, scratch.partialSpectra[level], beamIdx, 0, spectrum.getNumSamples());
+                    }
+                }
+            }
+            /** Overlap and save: the last blockSize samples of the frame are free of circular convolution aliasing */
+            const auto numFirst = jmin(blockSize, beamBuffer.getNumSamples() - beamBufferEnd);
+            if (numPartials > 0) {
+                spectrum.setReadyForConvolution();
+                const auto validSamples = spectrum.getTimeSeries(0, getWorkerFft(workerIdx, level)) +
+                                          spectrum.getFftSize() - blockSize;
+                beamBuffer.copyFrom(beamIdx, beamBufferEnd, validSamples, numFirst);
+                beamBuffer.copyFrom(beamIdx, 0, validSamples + numFirst, blockSize - numFirst);
+            } else {
+                beamBuffer.clear(beamIdx, beamBufferEnd, numFirst);
+                beamBuffer.clear(beamIdx, 0, blockSize - numFirst);
+            }
+            break;
+        }
+    }
+}
+
+const dsp::FFT *Beamformer::getWorkerFft(int workerIdx, int level) const {
+    /** Explicit for the calling thread too: the buffers copied from a shared input refer to the FFT of another instance */
+    const auto &levelFfts = workerScratch[workerIdx].levelFfts;
+    return levelFfts.empty() ? fftLevels[level].get() : levelFfts[level].get();
+}
+
+void Beamformer::convolveAndSum(AudioBufferFFT &dst, int dstCh, const AudioBufferFFT &in, const AudioBufferFFT &fir,
+                                const BigInteger &mics, bool accumulate) const {
+    if (beamSum != nullptr) {
+        (dst.*beamSum)(dstCh, in, fir, mics, accumulate);
+    } else {
+        dst.convolveAndSum(dstCh, in, fir, mics, accumulate);
+    }
+}
+
+int Beamformer::getFirFFTLen(const BeamParameters &params) const {
+    return alg->getFirFFTLen(params);
+}
+
+BigInteger Beamformer::getActiveMics(const BeamParameters &params) const {
+    return alg->getActiveMics(params);
+}
+
+String Beamformer::getDesignId() const {
+    return alg->getDesignId();
+}
+
+std::shared_ptr<dsp::FFT> Beamformer::getFft(int firFFTLen) const {
+    auto level = 0;
+    while ((level + 1 < int(fftLevels.size())) &&
+           (fftLevels[level + 1]->getSize() >= maximumExpectedSamplesPerBlock + firFFTLen - 1)) {
+        level++;
+    }
+    return fftLevels[level];
+}
+
+int Beamformer::getFftLevel(const AudioBufferFFT &buf) const {
+    auto level = 0;
+    while ((level + 1 < int(fftLevels.size())) && (fftLevels[level]->getSize() > buf.getFftSize())) {
+        level++;
+    }
+    return level;
+}
+
+void Beamformer::getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha) const {
+    alg->getFir(fir, params, alpha);
+}
+
+void Beamformer::getFirFFT(AudioBufferFFT &firFFT, const BeamParameters &params, float alpha) const {
+    alg->getFirFFT(firFFT, params, alpha);
+}
+
+void Beamformer::getDoaInputBuffer(AudioBufferFFT &dst) {
+    GenericScopedLock<SpinLock> lock(doaInputBufferLock);
+    dst = doaInputBuffer;
+    doaInputBufferNew = false;
+}
+
+void Beamformer::getBeams(AudioBuffer<float> &outBuffer) {
+    jassert(outBuffer.getNumChannels() >= numBeams);
+    jassert(outBuffer.getNumSamples() == blockSize);
+    
+    /** The last block, delayed by the output delay */
+    const auto beamBufferSize = beamBuffer.getNumSamples();
+    const auto start = (beamBufferEnd - blockSize - firOutputDelay + 2 * beamBufferSize) % beamBufferSize;
+    const auto numFirst = jmin(blockSize, beamBufferSize - start);
+    for (auto beamIdx = 0; beamIdx < numBeams; beamIdx++) {
+        outBuffer.copyFrom(beamIdx, 0, beamBuffer, beamIdx, start, numFirst);
+        outBuffer.copyFrom(beamIdx, numFirst, beamBuffer, beamIdx, 0, blockSize - numFirst);
+    }
+    for (auto channelIdx = numBeams; channelIdx < outBuffer.getNumChannels(); channelIdx++) {
+        outBuffer.clear(channelIdx, 0, blockSize);
+    }
+}
+
+int Beamformer::getNumBeams() const {
+    return numBeams;
+}
+
+void Beamformer::setDoaEnergy(const Mtx &energy) {
+    if (sharedInput != nullptr && sharedInput->isDoaOwner(this)) {
+        sharedInput->setDoaEnergy(energy);
+    }
+    GenericScopedLock<SpinLock> lock(doaLock);
+    doaLevels = energy;
+    doaOutputBufferNew = true;
+    doaReady = true;
+}
+
+void Beamformer::getDoaEnergy(Mtx &outDoaLevels) {
+    GenericScopedLock<SpinLock> lock(doaLock);
+    if (sharedInput != nullptr && !sharedInput->isDoaOwner(this)) {
+        /** DOA computed by another instance */
+        doaReady = sharedInput->getDoaEnergy(doaLevels);
+    }
+    outDoaLevels = doaLevels;
+    doaOutputBufferNew = false;
+}
+
+MemoryBlock Beamformer::getDoaEnergy(){
+    GenericScopedLock<SpinLock> lock(doaLock);
+    if (sharedInput != nullptr && !sharedInput->isDoaOwner(this)) {
+        /** DOA computed by another instance */
+        doaReady = sharedInput->getDoaEnergy(doaLevels);
+    }
+    
+    MemoryBlock mb(doaLevels.size()*sizeof(float)+2);
+    mb[0] = (uint8)doaLevels.rows();
+    mb[1] = (uint8)doaLevels.cols();
+    mb.copyFrom(doaLevels.data(), 2, doaLevels.size()*sizeof(float));
+    
+    doaOutputBufferNew = false;
+    return mb;
+}
+
+bool Beamformer::isDoaOutputBufferNew() const{
+    return doaOutputBufferNew;
+}
+
+bool Beamformer::isDoaReady() const {
+    return doaReady;
+}
+
+StageProfiler &Beamformer::getProfiler() {
+    return profiler;
+}
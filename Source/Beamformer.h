@@ -1,232 +1,694 @@
-/*
-  Beamforming processing class
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
-*/
-
-#pragma once
-
-#include "../JuceLibraryCode/JuceHeader.h"
-#include "AudioBufferFFT.h"
-#include "BeamformingAlgorithms.h"
-
-
-
-// ==============================================================================
-
-typedef Eigen::Matrix<std::complex<float>,Eigen::Dynamic,1> CplxVec;
-
-class Beamformer;
-
-/** Thread that computes periodically the Direction of Arrival of sound
- */
-class BeamformerDoa : public Thread {
-public:
-
-    BeamformerDoa(Beamformer &b,
-                  int numDoaHor_,
-                  int numDoaVer_,
-                  float sampleRate_,
-                  int numActiveInputChannels,
-                  int firLen,
-                  float expectedRate,
-                  std::shared_ptr<dsp::FFT> fft_);
-
-    ~BeamformerDoa();
-
-    void run() override;
-
-private:
-
-    /** Reference to the Beamformer */
-    Beamformer &beamformer;
-
-    /** Number of directions of arrival, horizontal axis */
-    int numDoaHor;
-    
-    /** Number of directions of arrival, vertical axis */
-    int numDoaVer;
-
-    /** Sampling frequency [Hz] */
-    float sampleRate;
-
-    /** FFT */
-    std::shared_ptr<dsp::FFT> fft;
-
-    /** Inputs' buffer */
-    AudioBufferFFT inputBuffer;
-
-    /** Convolution buffer */
-    AudioBufferFFT convolutionBuffer;
-
-    /** FIR filters for DOA estimation */
-    std::vector<AudioBufferFFT> doaFirFFT;
-
-    /** DOA levels [dB] */
-    Mtx doaLevels;
-    
-    /** New DOA levels [dB], pre-smoothing */
-    Mtx newDoaLevels;
-    
-    /** Smoothing factor */
-    float alpha = 1;
-    
-    /** Time constant for smothing [s] */
-    const float timeConst = 0.2;
-    
-    /**DOA update requency [Hz] */
-    float doaUpdateFrequency = 1;
-    
-    const float lowFreq = 500;
-    const float highFreq = 8000;
-    int lowFreqIdx = 0;
-    int numFreqBins = 1;
-
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BeamformerDoa);
-
-};
-
-// ==============================================================================
-
-class Beamformer {
-
-public:
-
-
-    /** Initialize the Beamformer with a set of static parameters.
-     @param numBeams: number of beams the beamformer has to compute
-     @param mic: microphone configuration
-     @param sampleRate:
-     @param maximumExpectedSamplesPerBlock:
-     @param doaRefreshRate:
-     */
-    Beamformer(int numBeams, MicConfig mic, double sampleRate, int maximumExpectedSamplesPerBlock, float doaRefreshRate);
-
-    /** Destructor. */
-    ~Beamformer();
-    
-    /** Get microphone configuration */
-    MicConfig getMicConfig() const;
-
-    /** Process a new block of samples.
-     
-     To be called inside AudioProcessor::processBlock.
-     */
-    void processBlock(const AudioBuffer<float> &inBuffer);
-
-    /** Copy the current beams outputs to the provided output buffer
-     
-     To be called inside AudioProcessor::processBlock, after Beamformer::processBlock
-     */
-    void getBeams(AudioBuffer<float> &outBuffer);
-
-    /** Set the parameters for a specific beam  */
-    void setBeamParameters(int beamIdx, const BeamParameters &beamParams);
-
-    /** Get FIR in time domain for a given direction of arrival
-    
-    @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
-    @param params: beam parameters
-    @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
-    */
-    void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const;
-
-    /** Copy the estimated energy contribution from the directions of arrival */
-    void getDoaEnergy(Mtx &energy);
-    
-    /** Get the estimated energy contribution from the directions of arrival */
-    MemoryBlock getDoaEnergy();
-
-    /** Set the estimated energy contribution from the directions of arrival */
-    void setDoaEnergy(const Mtx &energy);
-
-    /** Get last doa filtered input buffer */
-    void getDoaInputBuffer(AudioBufferFFT &dst);
-    
-    bool isDoaOutputBufferNew() const;
-
-
-private:
-
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Beamformer);
-
-    /** Sound speed [m/s] */
-    const float soundspeed = 343;
-
-    /** Sample rate [Hz] */
-    float sampleRate = 48000;
-
-    /** Maximum buffer size [samples] */
-    int maximumExpectedSamplesPerBlock = 64;
-
-    /** Number of microphones */
-    int numMic = 16;
-    
-    /** Number of rows */
-    int numRows = 1;
-
-    /** Number of beams */
-    int numBeams;
-
-    /** Number of directions of arrival */
-    int numDoaHor;
-    int numDoaVer;
-
-    /** Beamforming algorithm */
-    std::unique_ptr<BeamformingAlgorithm> alg;
-
-    /** FIR filters length. Diepends on the algorithm */
-    int firLen;
-
-    /** Shared FFT pointer */
-    std::shared_ptr<juce::dsp::FFT> fft;
-
-    /** FIR filters for each beam */
-    std::vector<AudioBuffer<float>> firIR;
-    std::vector<AudioBufferFFT> firFFT;
-
-    /** Inputs' buffer */
-    AudioBufferFFT inputBuffer;
-
-    /** Convolution buffer */
-    AudioBufferFFT convolutionBuffer;
-
-    /** Beams' outputs buffer */
-    AudioBuffer<float> beamBuffer;
-
-    /** FIR coefficients update time constant [s] */
-    const float firUpdateTimeConst = 0.2;
-    /** FIR coefficients update alpha */
-    float alpha = 1;
-
-    /** Microphones configuration */
-    MicConfig micConfig = ULA_1ESTICK;
-
-    /** Initialize the beamforming algorithm */
-    void initAlg();
-
-    /** DOA thread */
-    std::unique_ptr<BeamformerDoa> doaThread;
-
-
-    /** DOA levels [dB] */
-    Mtx doaLevels;
-
-    /** inputBuffer lock */
-    SpinLock doaInputBufferLock;
-
-    /** Input buffer with DOA-filtered input signal */
-    AudioBufferFFT doaInputBuffer;
-    
-    /** Flag to avoid useless copy if the previous doaInputBuffer hasn't been used yet */
-    bool doaInputBufferNew = false;
-
-    /** DOA Lock */
-    SpinLock doaLock;
-    
-    /** DOA Lock */
-    bool doaOutputBufferNew = false;
-
-
-};
+/*
+  Beamforming processing class
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioBufferFFT.h"
+#include "BeamformingAlgorithms.h"
+#include "SharedInput.h"
+#include "FilterBankFile.h"
+#include "StageProfiler.h"
+#include "TraceRecorder.h"
+#include "RealtimeCheck.h"
+
+/** Set to 1 to use the generic, dynamic-size, beamforming kernels instead of the ones specialized for each microphone configuration */
+#ifndef EBEAMER_DYNAMIC_KERNELS
+#define EBEAMER_DYNAMIC_KERNELS 0
+#endif
+
+
+// ==============================================================================
+
+typedef Eigen::Matrix<std::complex<float>,Eigen::Dynamic,1> CplxVec;
+
+class Beamformer;
+
+/** Thread that computes periodically the Direction of Arrival of sound
+ */
+class BeamformerDoa : public Thread {
+public:
+
+    BeamformerDoa(Beamformer &b,
+                  int numDoaHor_,
+                  int numDoaVer_,
+                  float sampleRate_,
+                  int numActiveInputChannels,
+                  float expectedRate,
+                  std::shared_ptr<dsp::FFT> fft_);
+
+    ~BeamformerDoa();
+
+    void run() override;
+
+private:
+
+    /** Get the DOA filters from the cache or from disk, or design them splitting the directions across the cores.
+     
+     Called by the thread before computing the DOA, so the Beamformer starts processing without waiting for the filters.
+     @return false if the thread has been asked to exit before the filters were ready
+     */
+    bool prepareFirs();
+    
+    /** Design the FIR filter of a direction */
+    void designFir(int dirIdx, AudioBufferFFT &fir);
+    
+    /** Version of the directions grid of designFir. Increase when the directions change */
+    static const int doaGridVersion = 1;
+
+    /** Reference to the Beamformer */
+    Beamformer &beamformer;
+
+    /** Number of directions of arrival, horizontal axis */
+    int numDoaHor;
+    
+    /** Number of directions of arrival, vertical axis */
+    int numDoaVer;
+
+    /** Sampling frequency [Hz] */
+    float sampleRate;
+
+    /** FFT */
+    std::shared_ptr<dsp::FFT> fft;
+
+    /** Inputs' buffer */
+    AudioBufferFFT inputBuffer;
+
+    /** Convolution buffer */
+    AudioBufferFFT convolutionBuffer;
+
+    /** FIR filters for DOA estimation, shared. nullptr until prepareFirs completes */
+    std::shared_ptr<const FilterBank> doaFirFFT;
+    
+    /** Microphones used for DOA estimation */
+    BigInteger doaMics;
+
+    /** DOA levels [dB] */
+    Mtx doaLevels;
+    
+    /** New DOA levels [dB], pre-smoothing */
+    Mtx newDoaLevels;
+    
+    /** Smoothing factor */
+    float alpha = 1;
+    
+    /** Time constant for smothing [s] */
+    const float timeConst = 0.2;
+    
+    /**DOA update requency [Hz] */
+    float doaUpdateFrequency = 1;
+    
+    /** Hardware counters of the DOA thread */
+    PerfCounters counters;
+    
+    const float lowFreq = 500;
+    const float highFreq = 8000;
+    int lowFreqIdx = 0;
+    int numFreqBins = 1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BeamformerDoa);
+
+};
+
+// ==============================================================================
+
+/** Thread that designs the beams' FIR filters and publishes them to the audio thread
+ 
+ Each beam has three prepared filter slots: one in use by the audio thread, one published, one being designed.
+ Slots are exchanged with an atomic swap, so the audio thread never waits for a design to complete.
+ */
+class BeamformerFirDesigner : public Thread {
+public:
+    
+    BeamformerFirDesigner(Beamformer &b,
+                          int numBeams_,
+                          int numMic_,
+                          std::shared_ptr<dsp::FFT> fft_);
+    
+    ~BeamformerFirDesigner();
+    
+    void run() override;
+    
+    /** Request the parameters for a specific beam.
+     
+     Non-blocking, to be called by the audio thread. If the designer is busy reading the requests, the call is dropped and the next one will be taken.
+     Beams are designed only once requested, the first design is exact.
+     */
+    void setBeamParameters(int beamIdx, const BeamParameters &beamParams);
+    
+    /** Get the most recent FIR filter for a specific beam, ready for convolution.
+     
+     To be called by the audio thread at block boundaries. The reference stays valid until the next call for the same beam.
+     */
+    const AudioBufferFFT &getBeamFir(int beamIdx);
+    
+    /** Get the microphones with a non-zero filter in the FIR returned by the last call to getBeamFir for the same beam */
+    const BigInteger &getBeamMics(int beamIdx) const;
+    
+    /** Check if the FIR returned by the last call to getBeamFir for the same beam has been designed, or is still the initial empty one */
+    bool isBeamFirDesigned(int beamIdx) const;
+    
+    /** Check if a filter has been published for each beam. Can be called from any thread */
+    bool areAllBeamsDesigned() const;
+    
+private:
+    
+    /** Reference to the Beamformer */
+    Beamformer &beamformer;
+    
+    /** Number of beams */
+    int numBeams;
+    
+    /** Number of microphones */
+    int numMic;
+    
+    /** FFT */
+    std::shared_ptr<dsp::FFT> fft;
+    
+    /** Design period while filters are converging [ms] */
+    const int designPeriodMs = 10;
+    
+    /** FIR coefficients update time constant [s] */
+    const float firUpdateTimeConst = 0.2;
+    
+    /** Time after the last parameter change at which the filter is snapped to its final value [s] */
+    const float firSettleTime = 1;
+    
+    /** Parameters requested by the audio thread */
+    std::vector<BeamParameters> requestedParams;
+    
+    /** Requested parameters lock */
+    SpinLock requestedParamsLock;
+    
+    /** Parameters requested at least once, for each beam */
+    std::vector<bool> requested;
+    
+    /** A filter has been designed, for each beam */
+    std::vector<bool> designed;
+    
+    /** Number of beams with a designed filter */
+    std::atomic<int> numBeamsDesigned {0};
+    
+    /** Parameters the filters are converging to */
+    std::vector<BeamParameters> targetParams;
+    
+    /** Filters have reached the target parameters */
+    std::vector<bool> converged;
+    
+    /** Time of the last change in parameters [ticks] */
+    std::vector<int64> lastChangeTicks;
+    
+    /** Time of the last design [ticks] */
+    std::vector<int64> lastDesignTicks;
+    
+    /** Smoothed FIR filters, ready for convolution */
+    std::vector<AudioBufferFFT> firFFTSmooth;
+    
+    /** Length of the smoothed FIR filters [samples] */
+    std::vector<int> firFFTSmoothLen;
+    
+    /** Microphones with a non-zero smoothed FIR filter */
+    std::vector<BigInteger> firFFTSmoothMics;
+    
+    /** Prepared FIR filters, numSlots for each beam, at the smallest FFT size that fits them */
+    std::vector<AudioBufferFFT> firFFT;
+    
+    /** Microphones with a non-zero filter, for each slot */
+    std::vector<BigInteger> firMics;
+    
+    /** Number of slots for each beam */
+    static const int numSlots = 3;
+    
+    /** Flag marking a slot published and not yet picked up by the audio thread */
+    static const int newSlotFlag = 4;
+    
+    /** Slot used by the audio thread, for each beam */
+    std::vector<int> audioSlot;
+    
+    /** Slot used by the audio thread holds a designed filter, for each beam */
+    std::vector<bool> audioSlotDesigned;
+    
+    /** Slot used by the designer, for each beam */
+    std::vector<int> designSlot;
+    
+    /** Published slot, for each beam */
+    std::unique_ptr<std::atomic<int>[]> publishedSlot;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BeamformerFirDesigner);
+    
+};
+
+// ==============================================================================
+
+/** Pool of real-time worker threads, helping the audio thread with the beamforming
+ 
+ Work is submitted in batches of independent tasks, claimed by the workers and by the calling thread one at a time.
+ Workers are pinned to a core each. After a batch they spin for spinTime, so the next batches of the same block are picked up
+ without any system call, then they sleep until woken up by a new batch.
+ */
+class BeamformerWorkers {
+public:
+    
+    /** Work split in tasks */
+    class Job {
+    public:
+        virtual ~Job() {};
+        
+        /** Run a single task.
+         
+         @param taskIdx: index of the task in the batch
+         @param workerIdx: index of the worker running the task. 0 is the thread calling BeamformerWorkers::run
+         */
+        virtual void runTask(int taskIdx, int workerIdx) = 0;
+    };
+    
+    /** Create and start the workers
+     
+     @param numThreads: number of worker threads, in addition to the calling thread
+     */
+    BeamformerWorkers(int numThreads);
+    
+    ~BeamformerWorkers();
+    
+    /** Number of workers, including the calling thread */
+    int getNumWorkers() const;
+    
+    /** Run a batch of tasks on the workers and on the calling thread. Returns when all the tasks are done */
+    void run(Job &job, int numTasks);
+    
+private:
+    
+    class Worker : public Thread {
+    public:
+        Worker(BeamformerWorkers &pool, int workerIdx);
+        
+        void run() override;
+        
+        /** The worker is sleeping and has to be notified of a new batch */
+        std::atomic<bool> sleeping{false};
+        
+    private:
+        BeamformerWorkers &pool;
+        int workerIdx;
+    };
+    
+    /** Claim and run tasks of a batch until all of them are claimed */
+    void runTasks(uint32 batchIdx, int workerIdx);
+    
+    /** Worker threads */
+    std::vector<std::unique_ptr<Worker>> workers;
+    
+    /** Current job */
+    std::atomic<Job *> job{nullptr};
+    
+    /** Number of tasks in the current batch */
+    std::atomic<int> numTasks{0};
+    
+    /** Number of tasks of the current batch completed */
+    std::atomic<int> tasksDone{0};
+    
+    /** Current batch index in the upper 32 bits, next task to be claimed in the lower 32 bits */
+    std::atomic<uint64> nextTask{0};
+    
+    /** Current batch index */
+    std::atomic<uint32> batch{0};
+    
+    /** Time spent spinning after each batch before sleeping [s] */
+    const double spinTime = 0.0005;
+    
+    /** Spinning time [ticks] */
+    int64 spinTicks;
+    
+    /** Sleep timeout, to check periodically for threadShouldExit [ms] */
+    const int sleepTimeoutMs = 100;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BeamformerWorkers);
+    
+};
+
+// ==============================================================================
+
+class Beamformer : private BeamformerWorkers::Job {
+
+public:
+
+
+    /** Initialize the Beamformer with a set of static parameters.
+     @param numBeams: number of beams the beamformer has to compute
+     @param mic: microphone configuration
+     @param sampleRate:
+     @param maximumExpectedSamplesPerBlock:
+     @param doaRefreshRate:
+     @param numWorkers: number of worker threads helping the calling thread in processBlock. 0 to process on the calling thread only
+     */
+    Beamformer(int numBeams, MicConfig mic, double sampleRate, int maximumExpectedSamplesPerBlock, float doaRefreshRate,
+               int numWorkers = 0);
+
+    /** Destructor. */
+    ~Beamformer();
+    
+    /** Get microphone configuration */
+    MicConfig getMicConfig() const;
+    
+    /** Get the number of microphones of a configuration */
+    static int getNumMic(MicConfig mic);
+    
+    /** Get the maximum block size the Beamformer was built for [samples] */
+    int getMaximumExpectedSamplesPerBlock() const;
+    
+    /** Get the number of worker threads helping the calling thread in processBlock */
+    int getNumWorkers() const;
+    
+    /** Get the delay of the beams for a source in the steering direction [samples]. Same for all the beams */
+    int getLatency() const;
+    
+    /** Check if the Beamformer can be used for a new set of static parameters, instead of building a new one.
+     
+     Blocks up to the maximum size the Beamformer was built for fit its buffers and filters.
+     */
+    bool canReuse(int numBeams, MicConfig mic, double sampleRate, int maximumExpectedSamplesPerBlock) const;
+    
+    /** Check if all the beams are processed with designed filters. To be called from the audio thread */
+    bool areBeamsReady() const;
+    
+    /** Check if a filter has been designed for all the beams, even if not picked up by processBlock yet.
+     Can be called from any thread
+     */
+    bool areBeamsDesigned() const;
+
+    /** Process a new block of samples.
+     
+     To be called inside AudioProcessor::processBlock.
+     @param publishInput: with a shared input, publish the block and its spectra. false to keep them private, when the
+     block was claimed by another instance
+     */
+    void processBlock(const AudioBuffer<float> &inBuffer, bool publishInput = true);
+    
+    /** Process a new block from the input and spectra published in the shared input by another instance.
+     
+     To be called inside AudioProcessor::processBlock, instead of processBlock, when SharedInput::claimBlock fails.
+     */
+    void processSharedBlock();
+    
+    /** Share the input spectra and the DOA with other instances. nullptr to stop sharing
+     
+     With a shared input, processBlock computes and publishes the spectra of the microphones requested by any instance,
+     unless told otherwise.
+     */
+    void setSharedInput(std::shared_ptr<SharedInput> sharedInput);
+
+    /** Copy the current beams outputs to the provided output buffer
+     
+     To be called inside AudioProcessor::processBlock, after Beamformer::processBlock
+     @param outBuffer: at least numBeams channels, as many samples as the last processed block. Further channels are cleared
+     */
+    void getBeams(AudioBuffer<float> &outBuffer);
+    
+    /** Get the number of beams */
+    int getNumBeams() const;
+
+    /** Set the parameters for a specific beam.
+     
+     The FIR filters are designed in background and picked up by processBlock when ready.
+     */
+    void setBeamParameters(int beamIdx, const BeamParameters &beamParams);
+
+    /** Get FIR in time domain for a given direction of arrival
+    
+    @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
+    @param params: beam parameters
+    @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+    */
+    void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const;
+    
+    /** Get FIR in frequency domain, ready for convolution, for a given direction of arrival
+     
+     @param firFFT: an AudioBufferFFT object with numChannels >= number of microphones, sharing the Beamformer FFT
+     @param params: beam parameters
+     @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+     */
+    void getFirFFT(AudioBufferFFT &firFFT, const BeamParameters &params, float alpha = 1) const;
+
+    /** Get the length of the filters designed by getFirFFT for the given parameters [samples] */
+    int getFirFFTLen(const BeamParameters &params) const;
+    
+    /** Get the microphones with a non-zero filter for the given parameters */
+    BigInteger getActiveMics(const BeamParameters &params) const;
+    
+    /** Get the identity of the filter design, see BeamformingAlgorithm::getDesignId */
+    String getDesignId() const;
+    
+    /** Get the smallest FFT that fits a filter of the given length and a block of maximumExpectedSamplesPerBlock
+     
+     @param firFFTLen: filter length [samples], from getFirFFTLen
+     */
+    std::shared_ptr<dsp::FFT> getFft(int firFFTLen) const;
+    
+    /** Convolve all the microphones with the corresponding FIR and sum them in frequency domain.
+     
+     Uses the kernel specialized for the microphone configuration.
+     @param dst: destination buffer, sharing the Beamformer FFT
+     @param dstCh: destination channel
+     @param in: microphones signals, ready for convolution
+     @param fir: FIR filters, ready for convolution
+     @param mics: microphones to sum
+     @param accumulate: add to the destination channel instead of overwriting it
+     */
+    void convolveAndSum(AudioBufferFFT &dst, int dstCh, const AudioBufferFFT &in, const AudioBufferFFT &fir,
+                        const BigInteger &mics, bool accumulate = false) const;
+
+    /** Copy the estimated energy contribution from the directions of arrival */
+    void getDoaEnergy(Mtx &energy);
+    
+    /** Get the estimated energy contribution from the directions of arrival */
+    MemoryBlock getDoaEnergy();
+
+    /** Set the estimated energy contribution from the directions of arrival */
+    void setDoaEnergy(const Mtx &energy);
+
+    /** Get last doa filtered input buffer */
+    void getDoaInputBuffer(AudioBufferFFT &dst);
+    
+    bool isDoaOutputBufferNew() const;
+    
+    /** Check if the DOA energy has been computed at least once. The DOA warms up while its filters are designed */
+    bool isDoaReady() const;
+    
+    /** Get the timing of the input FFT, convolution and IFFT phases, of the filters design and of the DOA cycles */
+    StageProfiler &getProfiler();
+
+
+private:
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Beamformer);
+
+    /** Sound speed [m/s] */
+    const float soundspeed = 343;
+
+    /** Sample rate [Hz] */
+    float sampleRate = 48000;
+
+    /** Maximum buffer size [samples] */
+    int maximumExpectedSamplesPerBlock = 64;
+
+    /** Number of microphones */
+    int numMic = 16;
+    
+    /** Number of rows */
+    int numRows = 1;
+
+    /** Number of beams */
+    int numBeams;
+
+    /** Number of directions of arrival */
+    int numDoaHor;
+    int numDoaVer;
+
+    /** Beamforming algorithm */
+    std::unique_ptr<BeamformingAlgorithm> alg;
+
+    /** FIR filters length. Diepends on the algorithm */
+    int firLen;
+    
+    /** Delay applied to the beams' outputs instead of the filters [samples] */
+    int firOutputDelay;
+
+    /** Shared FFT pointer */
+    std::shared_ptr<juce::dsp::FFT> fft;
+    
+    /** FFT objects for shorter filters. Level 0 is fft, each level halves the size */
+    std::vector<std::shared_ptr<juce::dsp::FFT>> fftLevels;
+    
+    /** Smallest FFT size for shorter filters */
+    static const int minFftLevelSize = 32;
+    
+    /** Get the level of the FFT size of a buffer */
+    int getFftLevel(const AudioBufferFFT &buf) const;
+
+    /** FIR filters designer thread */
+    std::unique_ptr<BeamformerFirDesigner> firDesigner;
+
+    /** Circular history of the inputs, as long as the largest FFT frame */
+    AudioBuffer<float> inputHistory;
+    
+    /** Sample of inputHistory following the last input sample */
+    int inputHistoryEnd = 0;
+    
+    /** Append a block of inputs to the history */
+    void appendInputHistory(const AudioBuffer<float> &block, int numSamples);
+    
+    /** Input block processed by another instance, when sharing the input */
+    AudioBuffer<float> sharedBlock;
+    
+    /** Number of samples of the current block */
+    int blockSize = 0;
+    
+    /** Inputs' spectra of the last frame, for each FFT level */
+    std::vector<AudioBufferFFT> inputBuffers;
+
+    /** Beams' spectra, numBeams for each FFT level */
+    std::vector<AudioBufferFFT> beamSpectra;
+    
+    /** All the microphones */
+    BigInteger allMics;
+    
+    /** Microphones used by at least one beam or by the DOA in the current block, for each FFT level.
+     When publishing a shared input, also the microphones requested by the other instances */
+    std::vector<BigInteger> levelInputMics;
+
+    /** Microphones whose spectra are published by the shared input, for each FFT level */
+    std::vector<BigInteger> sharedLevelMics;
+    
+    /** Filters used in the current block, for each beam */
+    std::vector<const AudioBufferFFT *> beamFirs;
+    
+    /** FFT level used in the current block, for each beam */
+    std::vector<int> beamLevels;
+    
+    /** Worker pool, nullptr if processBlock runs on the calling thread only */
+    std::unique_ptr<BeamformerWorkers> workers;
+    
+    /** Phases of processBlock, each one split in tasks */
+    enum class Phase {
+        /** One task for each microphone and FFT level in use: input frame FFT */
+        inputFFT,
+        /** One task for each beam tile: convolution and sum of a group of microphones in a partial beam spectrum */
+        beamTiles,
+        /** One task for each beam: sum of the partial beam spectra, inverse FFT and overlap and save */
+        beamReduce,
+    };
+    
+    /** Phase being run */
+    Phase phase = Phase::inputFFT;
+    
+    /** Input FFT task, the frame of a microphone at an FFT level */
+    struct InputTask {
+        int level;
+        int micIdx;
+    };
+    
+    /** Input FFT tasks of the current block */
+    std::vector<InputTask> inputTasks;
+    
+    /** Beam tile, the microphones of a group used by a beam */
+    struct BeamTile {
+        int beamIdx;
+        BigInteger mics;
+    };
+    
+    /** Tiles of the current block */
+    std::vector<BeamTile> beamTiles;
+    
+    /** Groups of microphones splitting the beams in tiles. A single group without workers, one eStick each otherwise */
+    std::vector<BigInteger> micGroups;
+    
+    /** Number of microphones in an eStick */
+    static const int numMicPerEstick = 16;
+    
+    /** Pre-allocated scratch buffers of each worker */
+    struct WorkerScratch {
+        /** Partial beams' spectra, numBeams channels for each FFT level */
+        std::vector<AudioBufferFFT> partialSpectra;
+        /** Partial beam spectrum written in the current block, for each beam */
+        std::vector<bool> beamTouched;
+        /** FFT engines of a worker thread, one for each FFT level. Empty for the calling thread, using fftLevels */
+        std::vector<std::unique_ptr<juce::dsp::FFT>> levelFfts;
+    };
+    
+    /** Scratch buffers, one for each worker */
+    std::vector<WorkerScratch> workerScratch;
+    
+    /** Input shared with other instances, nullptr if not sharing */
+    std::shared_ptr<SharedInput> sharedInput;
+    
+    /** Check if the DOA needs a new input block */
+    bool isDoaInputNeeded() const;
+    
+    /** Pick up the most recent filters, and collect the microphones and the FFT levels they and the DOA use */
+    void pickUpFilters(bool doaInputNeeded);
+    
+    /** Compute the beams from the input spectra */
+    void processBeams(bool doaInputNeeded);
+    
+    /** Run a phase of processBlock on the workers, or on the calling thread */
+    void runPhase(Phase p, int numTasks);
+    
+    /** Run a single task of the current phase */
+    void runTask(int taskIdx, int workerIdx) override;
+    
+    /** FFT engine of a worker for an FFT level */
+    const juce::dsp::FFT *getWorkerFft(int workerIdx, int level) const;
+    
+    /** Timing of the processing phases and of the background threads */
+    StageProfiler profiler;
+    
+    /** Hardware counters of the first thread calling processBlock. Blocks processed by other threads are not counted */
+    PerfCounters processCounters;
+
+    /** Circular buffer of the beams' outputs, holding the output delay and a block */
+    AudioBuffer<float> beamBuffer;
+    
+    /** Sample of beamBuffer following the last beams' output */
+    int beamBufferEnd = 0;
+
+    /** Microphones configuration */
+    MicConfig micConfig = ULA_1ESTICK;
+
+    /** Initialize the beamforming algorithm and the beam sum kernel specialized for the microphone configuration */
+    template<int NumMic, int NumRows>
+    void initAlg(float micDistX, float micDistY);
+    
+    /** Beam sum kernel for the microphone configuration. nullptr to use the generic one */
+    void (AudioBufferFFT::*beamSum)(int, const AudioBufferFFT &, const AudioBufferFFT &, const BigInteger &, bool) = nullptr;
+
+    /** DOA thread */
+    std::unique_ptr<BeamformerDoa> doaThread;
+
+
+    /** DOA levels [dB] */
+    Mtx doaLevels;
+
+    /** inputBuffer lock */
+    SpinLock doaInputBufferLock;
+
+    /** Input buffer with DOA-filtered input signal */
+    AudioBufferFFT doaInputBuffer;
+    
+    /** Flag to avoid useless copy if the previous doaInputBuffer hasn't been used yet */
+    bool doaInputBufferNew = false;
+
+    /** DOA Lock */
+    SpinLock doaLock;
+    
+    /** DOA Lock */
+    bool doaOutputBufferNew = false;
+    
+    /** DOA energy computed at least once */
+    std::atomic<bool> doaReady {false};
+
+
+};
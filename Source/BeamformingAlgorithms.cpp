@@ -1,98 +1,232 @@
-/*
-  Beamforming algorithms
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
-*/
-
-#include "BeamformingAlgorithms.h"
-
-namespace DAS {
-
-    FarfieldURA::FarfieldURA(float micDistX_, float micDistY_,
-                             int numMic_, int numRows_, float fs_, float soundspeed_) {
-
-        micDistX = micDistX_;
-        micDistY = micDistY_;
-        numMic = numMic_;
-        numRows = numRows_;
-        numMicPerRow = numMic/numRows;
-        fs = fs_;
-        soundspeed = soundspeed_;
-
-        commonDelay = 64;
-        const float maxDistBetweenMics =sqrt(pow((numMicPerRow-1) * micDistX,2.f)+pow((numRows-1) * micDistY,2.f));
-        firLen = maxDistBetweenMics / soundspeed * fs + commonDelay;
-
-        fft = std::make_unique<juce::dsp::FFT>(ceil(log2(firLen)));
-
-        win.resize(fft->getSize());
-        designTukeyWindow(win, fft->getSize(), commonDelay / 2);
-
-        freqAxes = Vec::LinSpaced(fft->getSize(), 0, fs * (fft->getSize() - 1) / fft->getSize());
-
-    }
-
-    int FarfieldURA::getFirLen() const {
-        return firLen;
-    }
-
-    void FarfieldURA::getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha) const {
-
-        /** Angle in radians (0 front, pi/2 source closer to last channel, -pi/2 source closer to first channel */
-        const float angleRadX = params.doaX * pi / 2;
-        /** Angle in radians (0 front, pi/2 source closer to last channel, -pi/2 source closer to first channel */
-        const float angleRadY = params.doaY * pi / 2;
-        /** Delay between adjacent microphones [s] */
-        const float deltaX = sin(angleRadX) * micDistX / soundspeed;
-        /** Delay between adjacent microphones [s] */
-        const float deltaY = sin(angleRadY) * micDistY / soundspeed;
-        /** Compute delays for each microphone, X component [s] */
-        const Vec micDelaysX = deltaX * Vec::LinSpaced(numMicPerRow, 0, numMicPerRow - 1);
-        /** Compute delays for each microphone, Y component [s] */
-        const Vec micDelaysY = deltaY * Vec::LinSpaced(numRows, 0, numRows - 1);
-        /** Matrix of delays. Eigen is column-first.*/
-        Mtx micDelaysMtx = micDelaysX.replicate(1,numRows) + micDelaysY.transpose().replicate(numMicPerRow,1);
-        /** Vector of delays */
-        Eigen::Map<Vec> micDelays(micDelaysMtx.data(),micDelaysMtx.size());
-        /** Compensate for minimum delay and apply common delay */
-        micDelays.array() += -micDelays.minCoeff() + commonDelay / fs;
-        /** Compute the fractional delays in frequency domain */
-        CpxMtx irFFT = (-j2pi * freqAxes * micDelays.transpose()).array().exp();
-
-
-        /** Compute how many microphones are muted at each end */
-        const int inactiveMicAtBorderX = roundToInt((numMicPerRow / 2 - 1) * params.width);
-        const int inactiveMicAtBorderY = roundToInt((numRows / 2 - 1) * params.width);
-        /** Generate the mask of active microphones.  Eigen is column-first.*/
-        Mtx micGainsMtx = Mtx::Ones(numMicPerRow,numRows);
-        for (auto colIdx = 0; colIdx < numRows; colIdx++){
-            if ((colIdx < inactiveMicAtBorderY) || (colIdx>=numRows-inactiveMicAtBorderY)){
-                micGainsMtx.col(colIdx).setZero();
-            }else{
-                micGainsMtx.col(colIdx).head(inactiveMicAtBorderX).array() = 0;
-                micGainsMtx.col(colIdx).tail(inactiveMicAtBorderX).array() = 0;
-            }
-        }
-        
-        Eigen::Map<Vec> micGains(micGainsMtx.data(),micGainsMtx.size());
-        
-        /** Normalize the power */
-        micGains.array() *= referencePower / micGains.sum();
-
-        /** Apply the gain */
-        irFFT = irFFT.cwiseProduct(micGains.transpose().replicate(freqAxes.size(), 1));
-
-        /** Convert  from requency to time domain and add to destination*/
-        for (auto micIdx = 0; micIdx < jmin(numMic, fir.getNumChannels()); micIdx++) {
-            freqToTime(fir, micIdx, irFFT.col(micIdx), fft.get(), win, alpha);
-        }
-        /** Clear the remaining FIR, if any */
-        for (auto micIdx = jmin(numMic, fir.getNumChannels()); micIdx < fir.getNumChannels(); micIdx++) {
-            fir.clear(micIdx, 0, fir.getNumSamples());
-        }
-
-    }
-
-
-}
+/*
+  Beamforming algorithms
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "BeamformingAlgorithms.h"
+
+namespace DAS {
+
+    FarfieldURA::FarfieldURA(float micDistX_, float micDistY_,
+                             int numMic_, int numRows_, float fs_, float soundspeed_) {
+
+        micDistX = micDistX_;
+        micDistY = micDistY_;
+        numMic = numMic_;
+        numRows = numRows_;
+        numMicPerRow = numMic/numRows;
+        fs = fs_;
+        soundspeed = soundspeed_;
+
+        commonDelay = 64;
+        kernelHalfLen = commonDelay / 2;
+        const float maxDistBetweenMics =sqrt(pow((numMicPerRow-1) * micDistX,2.f)+pow((numRows-1) * micDistY,2.f));
+        firLen = maxDistBetweenMics / soundspeed * fs + commonDelay;
+        firFFTDelay = commonDelay - kernelHalfLen;
+        /** The kernel of the most delayed microphone reaches kernelHalfLen samples past its integer delay */
+        maxFirFFTLen = ceil(maxDistBetweenMics / soundspeed * fs) + commonDelay + kernelHalfLen + 1 - firFFTDelay;
+
+        fft = getSharedFft(ceil(log2(firLen)));
+
+        /** Tukey windows, shared by FFT size and ramp length */
+        static SharedCache<std::pair<int, int>, const Vec> winCache;
+        const int winLen = fft->getSize();
+        const int rampLen = commonDelay / 2;
+        win = winCache.get({winLen, rampLen}, [winLen, rampLen]() {
+            auto newWin = std::make_shared<Vec>(winLen);
+            designTukeyWindow(*newWin, winLen, rampLen);
+            return newWin;
+        });
+
+    }
+
+    int FarfieldURA::getFirLen() const {
+        return firLen;
+    }
+
+    int FarfieldURA::getMaxFirFFTLen() const {
+        return maxFirFFTLen;
+    }
+
+    int FarfieldURA::getFirFFTDelay() const {
+        return firFFTDelay;
+    }
+
+    int FarfieldURA::getLatency() const {
+        return commonDelay;
+    }
+
+    int FarfieldURA::getFirFFTLen(const BeamParameters &params) const {
+
+        Vec micDelays, micGains;
+        getDelaysAndGains(params, micDelays, micGains);
+
+        /** Last non-zero sample of the kernel of the most delayed active microphone */
+        float maxDelay = -1;
+        for (auto micIdx = 0; micIdx < numMic; micIdx++) {
+            if (micGains(micIdx) != 0) {
+                maxDelay = jmax(maxDelay, micDelays(micIdx) * fs - firFFTDelay);
+            }
+        }
+        return maxDelay < 0 ? 0 : int(floor(maxDelay)) + kernelHalfLen + 1;
+    }
+
+    BigInteger FarfieldURA::getActiveMics(const BeamParameters &params) const {
+
+        Vec micDelays, micGains;
+        getDelaysAndGains(params, micDelays, micGains);
+
+        BigInteger activeMics;
+        for (auto micIdx = 0; micIdx < numMic; micIdx++) {
+            activeMics.setBit(micIdx, micGains(micIdx) != 0);
+        }
+        return activeMics;
+    }
+
+    String FarfieldURA::getDesignId() const {
+        return "ura" + String(designVersion) + "_" + String(numMic) + "x" + String(numRows) + "_" +
+               String(roundToInt(micDistX * 1e4)) + "x" + String(roundToInt(micDistY * 1e4)) + "_" +
+               String(roundToInt(soundspeed * 10)) + "_" + String(roundToInt(fs)) + "_" + String(commonDelay) + "_" +
+               String(kernelHalfLen) + "x" + String(numKernelFrac);
+    }
+
+    void FarfieldURA::prepareFirFFT(int fftSize) {
+        jassert(fftSize >= getMaxFirFFTLen());
+
+        firFFTSize = fftSize;
+        
+        /** Kernel banks, shared by FFT size and kernel length */
+        static SharedCache<std::pair<int, int>, const CpxMtx> kernelBankCache;
+        kernelBank = kernelBankCache.get({fftSize, kernelHalfLen}, [fftSize, this]() {
+            return std::make_shared<CpxMtx>(designKernelBank(fftSize));
+        });
+    }
+
+    CpxMtx FarfieldURA::designKernelBank(int fftSize) const {
+        
+        auto kernelFft = getSharedFft(roundToInt(log2(fftSize)));
+        std::vector<float> kernel(fftSize * 2);
+
+        /** Hann-tapered sinc, centered on the fractional delay, one column for each fractional step */
+        CpxMtx bank(fftSize / 2 + 1, numKernelFrac + 1);
+        for (auto fracIdx = 0; fracIdx <= numKernelFrac; fracIdx++) {
+            const double frac = double(fracIdx) / numKernelFrac;
+            std::fill(kernel.begin(), kernel.end(), 0.f);
+            double kernelSum = 0;
+            for (auto n = -kernelHalfLen; n <= kernelHalfLen; n++) {
+                const double x = n - frac;
+                if (std::abs(x) >= kernelHalfLen)
+                    continue;
+                const double sinc = x == 0 ? 1 : sin(MathConstants<double>::pi * x) / (MathConstants<double>::pi * x);
+                const double taper = 0.5 * (1 + cos(MathConstants<double>::pi * x / kernelHalfLen));
+                /** Negative indexes wrap around, the integer delay brings them back in the causal part */
+                kernel[(n + fftSize) % fftSize] = sinc * taper;
+                kernelSum += sinc * taper;
+            }
+            /** Unitary gain in DC */
+            FloatVectorOperations::multiply(kernel.data(), 1 / kernelSum, fftSize);
+            kernelFft->performRealOnlyForwardTransform(kernel.data(), true);
+            bank.col(fracIdx) = Eigen::Map<CpxVec>((std::complex<float> *) kernel.data(), fftSize / 2 + 1);
+        }
+        return bank;
+    }
+
+    void FarfieldURA::getFirFFT(AudioBufferFFT &firFFT, const BeamParameters &params, float alpha) const {
+        jassert(firFFT.getFftSize() == firFFTSize);
+
+        Vec micDelays, micGains;
+        getDelaysAndGains(params, micDelays, micGains);
+
+        /** Split delays in integer and fractional part [samples] */
+        const Vec micDelaysSpl = (micDelays * fs).array() - firFFTDelay;
+        const Vec micDelaysInt = micDelaysSpl.array().floor();
+
+        /** Compute the integer delays in frequency domain, non-negative frequencies only */
+        CpxMtx irFFT;
+        steeringVectors(irFFT, firFFTSize / 2 + 1, fs / firFFTSize, micDelaysInt / fs);
+
+        for (auto micIdx = 0; micIdx < jmin(numMic, firFFT.getNumChannels()); micIdx++) {
+            /** Apply the fractional delay, interpolating between adjacent kernels, and the gain */
+            const float frac = (micDelaysSpl(micIdx) - micDelaysInt(micIdx)) * numKernelFrac;
+            const int fracIdx = jlimit(0, numKernelFrac - 1, int(frac));
+            const float fracAlpha = frac - fracIdx;
+            irFFT.col(micIdx).array() *= micGains(micIdx) * ((1 - fracAlpha) * kernelBank->col(fracIdx).array() +
+                                                              fracAlpha * kernelBank->col(fracIdx + 1).array());
+            firFFT.setPreparedSpectrum(micIdx, irFFT.col(micIdx).data(), alpha);
+        }
+        /** Clear the remaining FIR, if any */
+        for (auto micIdx = jmin(numMic, firFFT.getNumChannels()); micIdx < firFFT.getNumChannels(); micIdx++) {
+            firFFT.clear(micIdx, 0, firFFT.getNumSamples());
+        }
+
+    }
+
+    void FarfieldURA::getDelaysAndGains(const BeamParameters &params, Vec &micDelays, Vec &micGains) const {
+
+        /** Angle in radians (0 front, pi/2 source closer to last channel, -pi/2 source closer to first channel */
+        const float angleRadX = params.doaX * pi / 2;
+        /** Angle in radians (0 front, pi/2 source closer to last channel, -pi/2 source closer to first channel */
+        const float angleRadY = params.doaY * pi / 2;
+        /** Delay between adjacent microphones [s] */
+        const float deltaX = sin(angleRadX) * micDistX / soundspeed;
+        /** Delay between adjacent microphones [s] */
+        const float deltaY = sin(angleRadY) * micDistY / soundspeed;
+        /** Compute delays for each microphone, X component [s] */
+        const Vec micDelaysX = deltaX * Vec::LinSpaced(numMicPerRow, 0, numMicPerRow - 1);
+        /** Compute delays for each microphone, Y component [s] */
+        const Vec micDelaysY = deltaY * Vec::LinSpaced(numRows, 0, numRows - 1);
+        /** Matrix of delays. Eigen is column-first.*/
+        Mtx micDelaysMtx = micDelaysX.replicate(1,numRows) + micDelaysY.transpose().replicate(numMicPerRow,1);
+        /** Vector of delays */
+        micDelays = Eigen::Map<Vec>(micDelaysMtx.data(),micDelaysMtx.size());
+        /** Compensate for minimum delay and apply common delay */
+        micDelays.array() += -micDelays.minCoeff() + commonDelay / fs;
+
+        /** Compute how many microphones are muted at each end */
+        const int inactiveMicAtBorderX = roundToInt((numMicPerRow / 2 - 1) * params.width);
+        const int inactiveMicAtBorderY = roundToInt((numRows / 2 - 1) * params.width);
+        /** Generate the mask of active microphones.  Eigen is column-first.*/
+        Mtx micGainsMtx = Mtx::Ones(numMicPerRow,numRows);
+        for (auto colIdx = 0; colIdx < numRows; colIdx++){
+            if ((colIdx < inactiveMicAtBorderY) || (colIdx>=numRows-inactiveMicAtBorderY)){
+                micGainsMtx.col(colIdx).setZero();
+            }else{
+                micGainsMtx.col(colIdx).head(inactiveMicAtBorderX).array() = 0;
+                micGainsMtx.col(colIdx).tail(inactiveMicAtBorderX).array() = 0;
+            }
+        }
+        
+        micGains = Eigen::Map<Vec>(micGainsMtx.data(),micGainsMtx.size());
+        
+        /** Normalize the power */
+        micGains.array() *= referencePower / micGains.sum();
+
+    }
+
+    void FarfieldURA::getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha) const {
+
+        Vec micDelays, micGains;
+        getDelaysAndGains(params, micDelays, micGains);
+
+        /** Compute the fractional delays in frequency domain, non-negative frequencies only */
+        CpxMtx irFFT;
+        steeringVectors(irFFT, fft->getSize() / 2 + 1, fs / fft->getSize(), micDelays);
+
+        /** Apply the gain */
+        irFFT = irFFT.cwiseProduct(micGains.transpose().replicate(irFFT.rows(), 1));
+
+        /** Convert  from requency to time domain and add to destination*/
+        for (auto micIdx = 0; micIdx < jmin(numMic, fir.getNumChannels()); micIdx++) {
+            freqToTime(fir, micIdx, irFFT.col(micIdx), fft.get(), *win, alpha);
+        }
+        /** Clear the remaining FIR, if any */
+        for (auto micIdx = jmin(numMic, fir.getNumChannels()); micIdx < fir.getNumChannels(); micIdx++) {
+            fir.clear(micIdx, 0, fir.getNumSamples());
+        }
+
+    }
+
+
+}
@@ -1,133 +1,239 @@
-/*
-  Beamforming algorithms
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
-*/
-
-#pragma once
-
-#include "../JuceLibraryCode/JuceHeader.h"
-#include "SignalProcessing.h"
-#include "BeamformingAlgorithms.h"
-
-/** Beam parameters data structure for a Uniform Rectangular Array
-    Convention used:
-    - Array seen from behind
-    - Upper-left microphone is number 0
-    - eSticks are running along the x axes
-    - eSticks are stacked along the y axes, top-most eStick has mic form 0 to 15
- */
-typedef struct {
-    /** Pointing direction of the beam, x axis.
-     Range: -1 (source closer to first microphone, left) to +1 (source closer to last microphone, right)
-     */
-    float doaX;
-    /** Pointing direction of the beam, y axis.
-    Range: -1 (source closer to first microphone, top) to +1 (source closer to last microphone, bottom)
-    */
-    float doaY;
-    /** Width of the beam.
-     Range: 0 (the most focused) to 1 (the least focused)
-     */
-    float width;
-} BeamParameters;
-
-
-/** Virtual class extended by all beamforming algorithms */
-class BeamformingAlgorithm {
-
-public:
-
-    virtual ~BeamformingAlgorithm() {};
-
-    /** Get the minimum FIR length for the given configuration [samples] */
-    virtual int getFirLen() const = 0;
-
-    /** Get FIR in time domain for a given direction of arrival
-     
-     @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
-     @param params: beam parameters
-     @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
-     */
-    virtual void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const = 0;
-
-};
-
-/** Delay-And-Sum Beamformers*/
-namespace DAS {
-
-/** Farfield Uniform Rectangular Array Beamformer
- 
- This class is used do setup a URA and compute the FIR impulse response
- */
-    class FarfieldURA : public BeamformingAlgorithm {
-
-    public:
-
-        /** initialize the URA
-
-         @param micDistX: microphones distance on the X axes [m]
-         @param micDistY: microphones distance on the Y axes [m]
-         @param numMic: total number of microphone capsules
-         @param numRows: total number of rows
-         @param fs: sampling frequency [Hz]
-         @param soundspeed: sampling frequency [m/s]
-         */
-        FarfieldURA(float micDistX, float micDistY, int numMic, int numRows, float fs, float soundspeed);
-
-        /** Get the minimum FIR length for the given configuration [samples] */
-        int getFirLen() const override;
-
-        /** Get FIR in time domain for a given direction of arrival
-
-         @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
-         @param params: beam parameters
-         @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
-         */
-        void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const override;
-
-    private:
-
-        /** Distance between microphones, X axes [m] */
-        float micDistX;
-        
-        /** Distance between microphones, Y axes [m] */
-        float micDistY;
-        
-        /** Number of microphones */
-        int numMic;
-        
-        /** Number of rows */
-        int numRows;
-        
-        /** Number of mic per row */
-        int numMicPerRow;
-
-        /** Sampling frequency [Hz] */
-        float fs;
-
-        /** Soundspeed [m/s] */
-        float soundspeed;
-
-        /** Common delay applied to all the filters to make filters causal [samples] */
-        int commonDelay;
-
-        /** Length of FIR filters [samples] */
-        int firLen;
-
-        /** FFT object */
-        std::unique_ptr<juce::dsp::FFT> fft;
-
-        /** Window applied to the FIR filters in time domain */
-        Vec win;
-
-        /** Frequencies axes */
-        Vec freqAxes;
-
-        /** Reference power for normalization */
-        const float referencePower = 1;
-
-    };
-
-}
+/*
+  Beamforming algorithms
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SignalProcessing.h"
+#include "AudioBufferFFT.h"
+#include "SharedCache.h"
+#include "BeamformingAlgorithms.h"
+
+/** Beam parameters data structure for a Uniform Rectangular Array
+    Convention used:
+    - Array seen from behind
+    - Upper-left microphone is number 0
+    - eSticks are running along the x axes
+    - eSticks are stacked along the y axes, top-most eStick has mic form 0 to 15
+ */
+typedef struct {
+    /** Pointing direction of the beam, x axis.
+     Range: -1 (source closer to first microphone, left) to +1 (source closer to last microphone, right)
+     */
+    float doaX;
+    /** Pointing direction of the beam, y axis.
+    Range: -1 (source closer to first microphone, top) to +1 (source closer to last microphone, bottom)
+    */
+    float doaY;
+    /** Width of the beam.
+     Range: 0 (the most focused) to 1 (the least focused)
+     */
+    float width;
+} BeamParameters;
+
+
+/** Virtual class extended by all beamforming algorithms */
+class BeamformingAlgorithm {
+
+public:
+
+    virtual ~BeamformingAlgorithm() {};
+
+    /** Get the minimum FIR length for the given configuration [samples] */
+    virtual int getFirLen() const = 0;
+
+    /** Get FIR in time domain for a given direction of arrival
+     
+     @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
+     @param params: beam parameters
+     @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+     */
+    virtual void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const = 0;
+
+    /** Prepare the design of FIR filters directly in frequency domain
+     
+     @param fftSize: size of the FFT the filters will be convolved with
+     */
+    virtual void prepareFirFFT(int fftSize) = 0;
+
+    /** Get FIR in frequency domain, ready for convolution, for a given direction of arrival
+     
+     @param firFFT: an AudioBufferFFT object with numChannels >= number of microphones and the FFT size given to prepareFirFFT
+     @param params: beam parameters
+     @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+     */
+    virtual void getFirFFT(AudioBufferFFT &firFFT, const BeamParameters &params, float alpha = 1) const = 0;
+
+    /** Get the length of the filters designed by getFirFFT for the given parameters [samples] */
+    virtual int getFirFFTLen(const BeamParameters &params) const = 0;
+
+    /** Get the maximum length of the filters designed by getFirFFT, for any parameters [samples] */
+    virtual int getMaxFirFFTLen() const = 0;
+
+    /** Get the microphones with a non-zero filter for the given parameters. One bit for each microphone */
+    virtual BigInteger getActiveMics(const BeamParameters &params) const = 0;
+
+    /** Get the identity of the filter design: the algorithm and its version, the geometry, the sampling frequency and
+     the design parameters. Filters saved with the same identity are the same as new ones
+     */
+    virtual String getDesignId() const = 0;
+
+    /** Get the delay to apply to the output of the filters designed by getFirFFT [samples].
+     
+     Same for all the parameters. Filters designed by getFir include it.
+     */
+    virtual int getFirFFTDelay() const = 0;
+
+    /** Get the delay of a source in the beam direction, from its arrival at the last microphone reached [samples].
+     
+     Same for all the parameters, for filters designed both by getFir and by getFirFFT with the output delay applied.
+     */
+    virtual int getLatency() const = 0;
+
+};
+
+/** Delay-And-Sum Beamformers*/
+namespace DAS {
+
+/** Farfield Uniform Rectangular Array Beamformer
+ 
+ This class is used do setup a URA and compute the FIR impulse response
+ */
+    class FarfieldURA : public BeamformingAlgorithm {
+
+    public:
+
+        /** initialize the URA
+
+         @param micDistX: microphones distance on the X axes [m]
+         @param micDistY: microphones distance on the Y axes [m]
+         @param numMic: total number of microphone capsules
+         @param numRows: total number of rows
+         @param fs: sampling frequency [Hz]
+         @param soundspeed: sampling frequency [m/s]
+         */
+        FarfieldURA(float micDistX, float micDistY, int numMic, int numRows, float fs, float soundspeed);
+
+        /** Get the minimum FIR length for the given configuration [samples] */
+        int getFirLen() const override;
+
+        /** Get FIR in time domain for a given direction of arrival
+
+         @param fir: an AudioBuffer object with numChannels >= number of microphones and numSamples >= firLen
+         @param params: beam parameters
+         @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+         */
+        void getFir(AudioBuffer<float> &fir, const BeamParameters &params, float alpha = 1) const override;
+
+        /** Prepare the fractional delay kernels for the given FFT size */
+        void prepareFirFFT(int fftSize) override;
+
+        /** Get FIR in frequency domain, ready for convolution, for a given direction of arrival.
+         
+         Integer delays are applied with steering vectors, fractional delays with a bank of tapered sinc kernels.
+         No FFT is computed. The common delay, except for the kernels' half length, is left to the output (see getFirFFTDelay).
+
+         @param firFFT: an AudioBufferFFT object with numChannels >= number of microphones and the FFT size given to prepareFirFFT
+         @param params: beam parameters
+         @param alpha: exponential interpolation coefficient. 1 means complete override (instant update), 0 means no override (complete preservation)
+         */
+        void getFirFFT(AudioBufferFFT &firFFT, const BeamParameters &params, float alpha = 1) const override;
+
+        /** Get the length of the filters designed by getFirFFT for the given parameters [samples].
+         
+         Follows the spread of the delays of the active microphones: broadside beams are the shortest.
+         */
+        int getFirFFTLen(const BeamParameters &params) const override;
+
+        /** Get the maximum length of the filters designed by getFirFFT, for any parameters [samples] */
+        int getMaxFirFFTLen() const override;
+
+        /** Get the microphones with a non-zero filter for the given parameters, depends on the beam width */
+        BigInteger getActiveMics(const BeamParameters &params) const override;
+
+        /** Get the identity of the filter design */
+        String getDesignId() const override;
+
+        /** Get the delay to apply to the output of the filters designed by getFirFFT [samples] */
+        int getFirFFTDelay() const override;
+
+        /** Get the delay of a source in the beam direction, from its arrival at the last microphone reached [samples].
+         
+         The microphone reached last is delayed by the common delay only.
+         */
+        int getLatency() const override;
+
+    protected:
+
+        /** Compute the delay [s] and gain of each microphone for the given beam parameters */
+        void getDelaysAndGains(const BeamParameters &params, Vec &micDelays, Vec &micGains) const;
+        
+        /** Design the fractional delay kernels for the given FFT size */
+        CpxMtx designKernelBank(int fftSize) const;
+
+        /** Distance between microphones, X axes [m] */
+        float micDistX;
+        
+        /** Distance between microphones, Y axes [m] */
+        float micDistY;
+        
+        /** Number of microphones */
+        int numMic;
+        
+        /** Number of rows */
+        int numRows;
+        
+        /** Number of mic per row */
+        int numMicPerRow;
+
+        /** Sampling frequency [Hz] */
+        float fs;
+
+        /** Soundspeed [m/s] */
+        float soundspeed;
+
+        /** Common delay applied to all the filters to make filters causal [samples] */
+        int commonDelay;
+
+        /** Half length of the fractional delay kernels [samples] */
+        int kernelHalfLen;
+
+        /** Length of FIR filters designed by getFir [samples] */
+        int firLen;
+
+        /** Part of the common delay applied to the output instead of the filters designed by getFirFFT [samples] */
+        int firFFTDelay;
+
+        /** Maximum length of the filters designed by getFirFFT, including the tail of the kernels [samples] */
+        int maxFirFFTLen;
+
+        /** FFT object, shared */
+        std::shared_ptr<juce::dsp::FFT> fft;
+
+        /** Window applied to the FIR filters in time domain, shared */
+        std::shared_ptr<const Vec> win;
+
+        /** Reference power for normalization */
+        const float referencePower = 1;
+
+        /** FFT size for filters designed in frequency domain */
+        int firFFTSize = 0;
+
+        /** Number of fractional delay steps in the kernel bank */
+        static const int numKernelFrac = 64;
+
+        /** Version of the filter design. Increase when the designed filters change for the same parameters */
+        static const int designVersion = 1;
+
+        /** Fractional delay kernels in frequency domain, non-negative frequencies only. One column for each fractional step.
+         Shared by all the arrays with the same FFT size.
+         */
+        std::shared_ptr<const CpxMtx> kernelBank;
+
+    };
+
+}
@@ -0,0 +1,141 @@
+/*
+  Filter banks persisted on disk
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "FilterBankFile.h"
+
+/** Filter bank file layout version. Increase when the layout changes */
+static const uint32 filterBankVersion = 3;
+
+/** Filter bank file header, followed by the spectra of each filter and channel, getStride floats each */
+struct FilterBankHeader {
+    char magic[4];
+    uint32 version;
+    /** Hash of the bank name */
+    uint64 nameHash;
+    uint32 numFilters;
+    uint32 numChannels;
+    uint32 fftSize;
+    /** Floats between two consecutive spectra */
+    uint32 stride;
+    /** Hash of the fields above */
+    uint64 headerHash;
+    /** Padding, keeps the spectra aligned */
+    uint8 reserved[24];
+};
+
+static_assert(sizeof(FilterBankHeader) == 64, "Filter bank header must keep the spectra aligned");
+
+static const char filterBankMagic[4] = {'E', 'B', 'F', 'B'};
+
+/** FNV-1a hash */
+static uint64 getHash(const void *data, size_t size, uint64 hash = 14695981039346656037ull) {
+    auto bytes = static_cast<const uint8 *>(data);
+    for (size_t byteIdx = 0; byteIdx < size; byteIdx++) {
+        hash = (hash ^ bytes[byteIdx]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/** Spectra ready for convolution take fftSize+1 floats. Padded to keep each spectrum 64 bytes aligned */
+static int getStride(int fftSize) {
+    return fftSize + 16;
+}
+
+static FilterBankHeader makeHeader(const String &name, int numFilters, int numChannels, int fftSize) {
+    FilterBankHeader header = {};
+    std::copy(filterBankMagic, filterBankMagic + 4, header.magic);
+    header.version = filterBankVersion;
+    header.nameHash = getHash(name.toRawUTF8(), name.getNumBytesAsUTF8());
+    header.numFilters = uint32(numFilters);
+    header.numChannels = uint32(numChannels);
+    header.fftSize = uint32(fftSize);
+    header.stride = uint32(getStride(fftSize));
+    header.headerHash = getHash(&header, offsetof(FilterBankHeader, headerHash));
+    return header;
+}
+
+File getFilterBankDirectory() {
+    return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("eBeamer").getChildFile(
+            "FilterBanks");
+}
+
+std::shared_ptr<const FilterBank> loadFilterBank(const String &name, int numFilters, int numChannels,
+                                                 std::shared_ptr<dsp::FFT> fft) {
+
+    const auto file = getFilterBankDirectory().getChildFile(name + ".bin");
+    if (!file.existsAsFile())
+        return nullptr;
+
+    /** The mapping lives as long as the filters referring to it */
+    struct MappedBank {
+        std::unique_ptr<MemoryMappedFile> mapping;
+        FilterBank bank;
+    };
+    auto mapped = std::make_shared<MappedBank>();
+    mapped->mapping = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+
+    const auto data = static_cast<const char *>(mapped->mapping->getData());
+    if (data == nullptr || mapped->mapping->getSize() < sizeof(FilterBankHeader))
+        return nullptr;
+
+    /** Validate the header and the size */
+    const auto expected = makeHeader(name, numFilters, numChannels, fft->getSize());
+    if (std::memcmp(data, &expected, offsetof(FilterBankHeader, reserved)) != 0)
+        return nullptr;
+    const auto spectrumBytes = sizeof(float) * expected.stride;
+    if (mapped->mapping->getSize() != sizeof(FilterBankHeader) + spectrumBytes * numFilters * numChannels)
+        return nullptr;
+
+    /** Refer to the mapped spectra */
+    auto spectra = reinterpret_cast<float *>(const_cast<char *>(data + sizeof(FilterBankHeader)));
+    std::vector<float *> channels(numChannels);
+    mapped->bank.reserve(numFilters);
+    for (auto filterIdx = 0; filterIdx < numFilters; filterIdx++) {
+        for (auto channelIdx = 0; channelIdx < numChannels; channelIdx++) {
+            channels[channelIdx] = spectra + (size_t(filterIdx) * numChannels + channelIdx) * expected.stride;
+        }
+        mapped->bank.emplace_back(channels.data(), numChannels, fft);
+    }
+
+    return std::shared_ptr<const FilterBank>(mapped, &mapped->bank);
+}
+
+bool saveFilterBank(const String &name, const FilterBank &bank) {
+
+    if (bank.empty())
+        return false;
+
+    const auto numChannels = bank.front().getNumChannels();
+    const auto fftSize = bank.front().getFftSize();
+    const auto file = getFilterBankDirectory().getChildFile(name + ".bin");
+    if (!file.getParentDirectory().createDirectory())
+        return false;
+
+    TemporaryFile tempFile(file);
+    {
+        FileOutputStream stream(tempFile.getFile());
+        if (!stream.openedOk())
+            return false;
+
+        const auto header = makeHeader(name, int(bank.size()), numChannels, fftSize);
+        stream.write(&header, sizeof(header));
+
+        const std::vector<float> padding(header.stride - (fftSize + 1), 0);
+        for (const auto &filter : bank) {
+            jassert(filter.isReadyForConvolution());
+            jassert(filter.getNumChannels() == numChannels && filter.getFftSize() == fftSize);
+            for (auto channelIdx = 0; channelIdx < numChannels; channelIdx++) {
+                stream.write(filter.getReadPointer(channelIdx), sizeof(float) * (fftSize + 1));
+                stream.write(padding.data(), sizeof(float) * padding.size());
+            }
+        }
+        stream.flush();
+        if (stream.getStatus().failed())
+            return false;
+    }
+    return tempFile.overwriteTargetFileWithTemporary();
+}
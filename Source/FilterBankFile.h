@@ -0,0 +1,40 @@
+/*
+  Filter banks persisted on disk
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioBufferFFT.h"
+
+/** Bank of filters ready for convolution, all with the same number of channels and FFT size */
+typedef std::vector<AudioBufferFFT> FilterBank;
+
+/** Load a filter bank from the cache directory.
+
+ The file is memory-mapped read-only and the filters refer to the mapped spectra, without copying them:
+ the pages are loaded on first use and shared by all the processes using the same bank.
+ The returned bank keeps the file mapped.
+ @param name: bank identity, also used as file name
+ @param numFilters: expected number of filters
+ @param numChannels: expected number of channels of each filter
+ @param fft: FFT of the filters
+ @return nullptr if the file is missing, or its header doesn't match the name, the version or the sizes
+ */
+std::shared_ptr<const FilterBank> loadFilterBank(const String &name, int numFilters, int numChannels,
+                                                 std::shared_ptr<dsp::FFT> fft);
+
+/** Save a filter bank in the cache directory.
+
+ The file is written to a temporary file and then moved in place, so readers never see a partial bank.
+ @param name: bank identity, also used as file name
+ @param bank: filters ready for convolution
+ @return false if the file couldn't be written
+ */
+bool saveFilterBank(const String &name, const FilterBank &bank);
+
+/** Directory of the filter bank files */
+File getFilterBankDirectory();
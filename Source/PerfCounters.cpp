@@ -0,0 +1,120 @@
+/*
+  Hardware performance counters of the calling thread
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "PerfCounters.h"
+#include "RealtimeCheck.h"
+
+#if JUCE_LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Counters enabled */
+static std::atomic<bool> countersEnabled {false};
+
+/** A thread failed to open the counters */
+static std::atomic<bool> countersFailed {false};
+
+PerfCounters::Reading PerfCounters::Reading::operator-(const Reading &start) const {
+    Reading delta;
+    for (auto counterIdx = 0; counterIdx < numCounters; counterIdx++) {
+        delta.values[counterIdx] = values[counterIdx] - start.values[counterIdx];
+    }
+    return delta;
+}
+
+void PerfCounters::setEnabled(bool shouldBeEnabled) {
+    countersEnabled = shouldBeEnabled;
+}
+
+bool PerfCounters::isEnabled() {
+    return countersEnabled.load(std::memory_order_relaxed);
+}
+
+bool PerfCounters::isAvailable() {
+    return isEnabled() && !countersFailed;
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+bool PerfCounters::prepare() {
+    if (!opened && isEnabled()) {
+        /** Accepted once for each thread, when the counters are enabled */
+        const RealtimeCheck::ScopedPermit permit;
+        opened = true;
+        owner = Thread::getCurrentThreadId();
+        if (!open()) {
+            countersFailed = true;
+        }
+    }
+    return numOpen > 0 && isEnabled() && Thread::getCurrentThreadId() == owner;
+}
+
+bool PerfCounters::open() {
+#if JUCE_LINUX
+    const uint64 configs[numCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                         PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (auto counterIdx = 0; counterIdx < numCounters; counterIdx++) {
+        perf_event_attr attr;
+        zerostruct(attr);
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[counterIdx];
+        attr.read_format = PERF_FORMAT_GROUP;
+        /** User space only, permitted up to perf_event_paranoid 2 */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        const auto fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, leaderFd, 0));
+        if (fd >= 0) {
+            fds[counterIdx] = fd;
+            groupIdx[counterIdx] = numOpen++;
+            if (leaderFd < 0) {
+                leaderFd = fd;
+            }
+        }
+    }
+    return numOpen > 0;
+#else
+    return false;
+#endif
+}
+
+void PerfCounters::close() {
+#if JUCE_LINUX
+    for (auto &fd : fds) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+#endif
+    numOpen = 0;
+    leaderFd = -1;
+}
+
+PerfCounters::Reading PerfCounters::read() const {
+    Reading reading;
+#if JUCE_LINUX
+    if (numOpen == 0)
+        return reading;
+
+    /** Group reading: number of counters, then their values in the order they were opened */
+    uint64 values[1 + numCounters] = {};
+    const RealtimeCheck::ScopedPermit permit;
+    if (::read(leaderFd, values, sizeof(values)) <= 0)
+        return reading;
+    for (auto counterIdx = 0; counterIdx < numCounters; counterIdx++) {
+        if (groupIdx[counterIdx] >= 0) {
+            reading.values[counterIdx] = values[1 + groupIdx[counterIdx]];
+        }
+    }
+#endif
+    return reading;
+}
@@ -0,0 +1,87 @@
+/*
+  Hardware performance counters of the calling thread
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Cycles, instructions, cache misses and branch misses of the calling thread, from perf_event_open on Linux.
+
+ Optional and off by default. The counters are opened by the thread they count, the first time it samples them after
+ being enabled, and can't be read by any other thread: a host moving the processing across threads leaves the blocks
+ processed by the other threads uncounted. Where they are not available, e.g. on other platforms, without the kernel support or when
+ perf_event_paranoid doesn't permit them, open fails and the readings stay at zero.
+ A single counter not supported by the CPU is left at zero, the others are still counted.
+ */
+class PerfCounters {
+public:
+
+    /** Counted events */
+    enum Counter {
+        cycles,
+        instructions,
+        cacheMisses,
+        branchMisses,
+        numCounters
+    };
+
+    /** Values of the counters */
+    struct Reading {
+        uint64 values[numCounters] = {};
+
+        /** Events between two readings */
+        Reading operator-(const Reading &start) const;
+    };
+
+    /** Enable or disable the counters of all the threads */
+    static void setEnabled(bool shouldBeEnabled);
+
+    /** Check if the counters are enabled */
+    static bool isEnabled();
+
+    /** Check if the counters have been enabled and no thread failed to open them */
+    static bool isAvailable();
+
+    ~PerfCounters();
+
+    /** Check if the counters of the calling thread can be read, opening them if enabled and not tried yet.
+
+     Opening costs a few system calls, once for each thread.
+     @return false if the counters are not available, or were opened by another thread
+     */
+    bool prepare();
+
+    /** Read the counters, with a single system call */
+    Reading read() const;
+
+private:
+
+    /** File descriptor of each counter, -1 if not open */
+    int fds[numCounters] = {-1, -1, -1, -1};
+
+    /** File descriptor of the first counter open, leading the group */
+    int leaderFd = -1;
+
+    /** Position of each counter in the group reading, -1 if not open */
+    int groupIdx[numCounters] = {-1, -1, -1, -1};
+
+    /** Number of counters in the group */
+    int numOpen = 0;
+
+    /** Open tried */
+    bool opened = false;
+
+    /** Thread the counters were opened by, the one they count */
+    Thread::ThreadID owner = nullptr;
+
+    /** Open the counters on the calling thread */
+    bool open();
+
+    /** Close the counters */
+    void close();
+
+};
@@ -1,737 +1,1339 @@
-/*
- eBeamer Plugin Processor
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
- */
-
-#include "PluginProcessor.h"
-#include "PluginEditor.h"
-
-//==============================================================================
-
-// Helper functions
-AudioProcessorValueTreeState::ParameterLayout initializeParameters() {
-    
-    
-    std::vector<std::unique_ptr<RangedAudioParameter>> params;
-    
-    // Values in dB
-    params.push_back(std::make_unique<AudioParameterChoice>(configIdentifier.toString(), //tag
-                                                            "Configuration", //name
-                                                            micConfigLabels, //choices
-                                                            0 //default
-                                                            ));
-    
-    params.push_back(std::make_unique<AudioParameterBool>(frontIdentifier.toString(), //tag
-                                                          "Front facing", //name
-                                                          false //default
-                                                          ));
-    
-    params.push_back(std::make_unique<AudioParameterFloat>(gainIdentifier.toString(), //tag
-                                                           "Mic gain", //name
-                                                           MIN_GAIN, //min
-                                                           MAX_GAIN, //max
-                                                           DEFAULT_GAIN //default
-                                                           ));
-    
-    // Values in Hz
-    params.push_back(std::make_unique<AudioParameterFloat>(hpfIdentifier.toString(), //tag
-                                                           "HPF",
-                                                           MIN_HPF, //min
-                                                           MAX_HPF, //max
-                                                           DEFAULT_HPF //default
-                                                           ));
-    
-    {
-        for (auto beamIdx = 0; beamIdx < 2; ++beamIdx) {
-            auto defaultDirectionX = beamIdx == 0 ? -0.5 : 0.5;
-            params.push_back(std::make_unique<AudioParameterFloat>(steerXIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                   "Steer " + String(beamIdx + 1) + " hor", //name
-                                                                   -1.0f, //min
-                                                                   1.0f, //max
-                                                                   defaultDirectionX //default
-                                                                   ));
-            
-            params.push_back(std::make_unique<AudioParameterFloat>(steerYIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                   "Steer " + String(beamIdx + 1) + " ver", //name
-                                                                   -1.0f, //min
-                                                                   1.0f, //max
-                                                                   0 //default
-                                                                   ));
-            
-            params.push_back(std::make_unique<AudioParameterFloat>(widthIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                   "Width beam" + String(beamIdx + 1), //name
-                                                                   0.0f, //min
-                                                                   1.0f,//max
-                                                                   0.3f//default
-                                                                   ));
-            
-            auto defaultPan = beamIdx == 0 ? -0.5 : 0.5;
-            params.push_back(std::make_unique<AudioParameterFloat>(panIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                   "Pan beam" + String(beamIdx + 1), //name
-                                                                   -1.0f, //min
-                                                                   1.0f, //max
-                                                                   defaultPan //default
-                                                                   ));
-            
-            params.push_back(std::make_unique<AudioParameterFloat>(levelIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                   "Level beam" + String(beamIdx + 1), //name
-                                                                   MIN_LEVEL, //min
-                                                                   MAX_LEVEL, //max
-                                                                   0.0f //default
-                                                                   ));
-            
-            params.push_back(std::make_unique<AudioParameterBool>(muteIdentifierPrefix + String(beamIdx + 1), //tag
-                                                                  "Mute beam" + String(beamIdx + 1), //name
-                                                                  false //default
-                                                                  ));
-            
-        }
-    }
-    
-    return {params.begin(), params.end()};
-}
-
-
-//==============================================================================
-//The default bus layout accommodates for 4 buses of 16 channels each for VST3 mode, one bus with 64 channels for standalone mode.
-EbeamerAudioProcessor::EbeamerAudioProcessor()
-: AudioProcessor(JUCEApplication::isStandaloneApp()
-                 ?
-                 BusesProperties()
-                 .withInput("eSticks", AudioChannelSet::channelSetsWithNumberOfChannels(64)[0])
-                 .withOutput("Output", AudioChannelSet::stereo(), true)
-                 :
-                 BusesProperties()
-                 .withInput("eStick#1", AudioChannelSet::ambisonic(3), true)
-                 .withInput("eStick#2", AudioChannelSet::ambisonic(3), true)
-                 .withInput("eStick#3", AudioChannelSet::ambisonic(3), true)
-                 .withInput("eStick#4", AudioChannelSet::ambisonic(3), true)
-                 .withOutput("Output", AudioChannelSet::stereo(), true)
-                 ),
-parameters(*this,
-           nullptr,
-           Identifier("eBeamerParams"),
-           initializeParameters()
-           )
-{
-    
-    /** Setup parameters listener and pointers */
-    configParam = parameters.getRawParameterValue(configIdentifier.toString());
-    frontFacingParam = parameters.getRawParameterValue(frontIdentifier.toString());
-    hpfFreqParam = parameters.getRawParameterValue(hpfIdentifier.toString());
-    micGainParam = parameters.getRawParameterValue(gainIdentifier.toString());
-    
-    parameters.addParameterListener(configIdentifier.toString(), this);
-    parameters.addParameterListener(frontIdentifier.toString(), this);
-    parameters.addParameterListener(hpfIdentifier.toString(), this);
-    parameters.addParameterListener(gainIdentifier.toString(), this);
-    
-    for (auto beamIdx = 0; beamIdx < 2; beamIdx++) {
-        steerBeamXParam[beamIdx] = parameters.getRawParameterValue(steerXIdentifierPrefix + String(beamIdx + 1));
-        steerBeamYParam[beamIdx] = parameters.getRawParameterValue(steerYIdentifierPrefix + String(beamIdx + 1));
-        widthBeamParam[beamIdx] = parameters.getRawParameterValue(widthIdentifierPrefix + String(beamIdx + 1));
-        panBeamParam[beamIdx] = parameters.getRawParameterValue(panIdentifierPrefix + String(beamIdx + 1));
-        levelBeamParam[beamIdx] = parameters.getRawParameterValue(levelIdentifierPrefix + String(beamIdx + 1));
-        muteBeamParam[beamIdx] = parameters.getRawParameterValue(muteIdentifierPrefix + String(beamIdx + 1));
-        
-        parameters.addParameterListener(steerXIdentifierPrefix + String(beamIdx + 1), this);
-        parameters.addParameterListener(steerYIdentifierPrefix + String(beamIdx + 1), this);
-        parameters.addParameterListener(widthIdentifierPrefix + String(beamIdx + 1), this);
-        parameters.addParameterListener(panIdentifierPrefix + String(beamIdx + 1), this);
-        parameters.addParameterListener(levelIdentifierPrefix + String(beamIdx + 1), this);
-        parameters.addParameterListener(muteIdentifierPrefix + String(beamIdx + 1), this);
-    }
-    
-    /* Value tree for session parameters */
-    valueTree = ValueTree("Ebeamer");
-    initValueTreeParameters(valueTree);
-    valueTree.setProperty(serverPortIdentifier, 0, nullptr);
-    
-    syncParametersToValueTree();
-    
-    /** Listen to valueTree to keep in sync with parameters */
-    valueTree.addListener(this);
-    
-    //==============================================================================
-    /* OSC controller */
-    oscController.init(valueTree);
-    registerCommonOscParameters(oscController);
-    if (oscController.startReceiver()){
-        valueTree.setProperty(serverPortIdentifier, oscController.getReceiverPort(), nullptr);
-        oscController.startBroadcast();
-    }else{
-        std::ostringstream errMsg;
-        errMsg << "Error: cannot initialize OSC receiver";
-        showConnectionErrorMessage (errMsg.str());
-    }
-    
-}
-
-//==============================================================================
-bool EbeamerAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const {
-    if (!JUCEApplication::isStandaloneApp()){
-        // This plug-in supports up to 4 eSticks, for a total amount of 64 channels in input.
-        // VST3 allows for a maximum of 25 channels per bus.
-        // To make things simpler in terms of patching, for VST each input bus counts for at most 16 channels.
-        // This configuration allows REAPER to be configured with a 64 channels track.
-        
-        for (auto bus : layouts.inputBuses) {
-            if (bus.size() > 16) {
-                return false;
-            }
-        }
-        for (auto bus : layouts.outputBuses) {
-            if (bus.size() > 16) {
-                // We have to allow the output bus to grow to the size of the input bus for compatibility with REAPER
-                return false;
-            }
-        }
-    }
-    
-    if ((layouts.getMainInputChannels() < 1) || (layouts.getMainOutputChannels() < 2)) {
-        // In any case don't allow less than 1 input and 2 output channels
-        return false;
-    }
-    return true;
-}
-
-//==============================================================================
-void EbeamerAudioProcessor::prepareToPlay(double sampleRate_, int maximumExpectedSamplesPerBlock_) {
-    
-    GenericScopedLock<SpinLock> lock(processingLock);
-    
-    stopTimer();
-    
-    sampleRate = sampleRate_;
-    maximumExpectedSamplesPerBlock = maximumExpectedSamplesPerBlock_;
-    
-    /** Number of active input channels */
-    numActiveInputChannels = getTotalNumInputChannels();
-    
-    /** Number of active output channels */
-    numActiveOutputChannels = jmin(2, getTotalNumOutputChannels());
-    
-    /** Initialize the input gain */
-    micGain.reset();
-    micGain.prepare({sampleRate, static_cast<uint32>(maximumExpectedSamplesPerBlock), numActiveInputChannels});
-    micGain.setGainDecibels(*micGainParam);
-    micGain.setRampDurationSeconds(gainTimeConst);
-    
-    /** Initialize the High Pass Filters */
-    iirHPFfilters.clear();
-    iirHPFfilters.resize(numActiveInputChannels);
-    prevHpfFreq = 0;
-    
-    /** Initialize the beamformer */
-    beamformer = std::make_unique<Beamformer>(2, static_cast<MicConfig>((int) *configParam),sampleRate, maximumExpectedSamplesPerBlock, metersUpdateRate);
-    
-    /** Initialize beams' buffer  */
-    beamBuffer.setSize(2, maximumExpectedSamplesPerBlock);
-    
-    /** Initialize beam level gains */
-    for (auto beamIdx = 0; beamIdx < 2; ++beamIdx) {
-        beamGain[beamIdx].reset();
-        beamGain[beamIdx].prepare({sampleRate, static_cast<uint32>(maximumExpectedSamplesPerBlock), 1});
-        beamGain[beamIdx].setGainDecibels(*levelBeamParam[beamIdx]);
-        beamGain[beamIdx].setRampDurationSeconds(gainTimeConst);
-    }
-    
-    /** initialize meters */
-    inputMeterDecay = std::make_unique<MeterDecay>(sampleRate, metersDecay, maximumExpectedSamplesPerBlock,
-                                                   numActiveInputChannels);
-    beamMeterDecay = std::make_unique<MeterDecay>(sampleRate, metersDecay, maximumExpectedSamplesPerBlock, 2);
-    
-    resourcesAllocated = true;
-    
-    /** Time constants */
-    loadAlpha = 1 - exp(-(maximumExpectedSamplesPerBlock / sampleRate) / loadTimeConst);
-    
-    startTimerHz(metersUpdateRate);
-}
-
-void EbeamerAudioProcessor::releaseResources() {
-    
-    GenericScopedLock<SpinLock> lock(processingLock);
-    
-    resourcesAllocated = false;
-    
-    /** Clear beam buffer */
-    beamBuffer.setSize(2, 0);
-    
-    /** Clear the HPF */
-    iirHPFfilters.clear();
-    
-    /** Clear the Beamformer */
-    beamformer.reset();
-}
-
-bool EbeamerAudioProcessor::insertCCParamMapping(const MidiCC &cc, const String &param) {
-    if (paramToCcMap.count(param) > 0 || ccToParamMap.count(cc) > 0) {
-        return false;
-    }
-    ccToParamMap[cc] = param;
-    paramToCcMap[param] = cc;
-    return true;
-}
-
-void EbeamerAudioProcessor::removeCCParamMapping(const String &param) {
-    if (paramToCcMap.count(param) > 0) {
-        auto cc = paramToCcMap[param];
-        paramToCcMap.erase(param);
-        ccToParamMap.erase(cc);
-    }
-}
-
-void EbeamerAudioProcessor::processCC(const MidiCC &cc, int value) {
-    
-    const String paramTag = ccToParamMap[cc];
-    Value val = parameters.getParameterAsValue(paramTag);
-    auto range = parameters.getParameterRange(paramTag);
-    const bool isButton = range.interval == 1 && range.start == 0 && range.end == 1;
-    if (isButton) {
-        if (value == 127) {
-            val.setValue(!((bool) val.getValue()));
-        }
-    } else {
-        val.setValue(range.convertFrom0to1(value / 127.));
-    }
-    
-}
-
-void EbeamerAudioProcessor::startCCLearning(const String &p) {
-    paramCCToLearn = p;
-}
-
-void EbeamerAudioProcessor::stopCCLearning() {
-    paramCCToLearn = "";
-}
-
-String EbeamerAudioProcessor::getCCLearning() const {
-    return paramCCToLearn;
-}
-
-const std::map<String, MidiCC> &EbeamerAudioProcessor::getParamToCCMapping() {
-    return paramToCcMap;
-}
-
-void EbeamerAudioProcessor::processMidi(MidiBuffer &midiMessages) {
-    
-    // Loop over Midi messages
-    for (const MidiMessageMetadata metadata : midiMessages){
-        MidiMessage midiMess = metadata.getMessage();
-        
-        if (midiMess.isController()) {
-            
-            MidiCC cc = {midiMess.getChannel(), midiMess.getControllerNumber()};
-            if (ccToParamMap.count(cc) > 0) {
-                /** Process the CC message if mapped */
-                processCC(cc, midiMess.getControllerValue());
-            } else if (paramCCToLearn.length() > 0) {
-                /** Remove then add the CC parameter */
-                removeCCParamMapping(paramCCToLearn);
-                insertCCParamMapping(cc, paramCCToLearn);
-            }
-        }
-    }
-    
-    /** Clear all messages */
-    midiMessages.clear();
-    
-}
-
-void EbeamerAudioProcessor::processBlock(AudioBuffer<float> &buffer, MidiBuffer &midiMessages) {
-    
-    const auto startTick = Time::getHighResolutionTicks();
-    
-    GenericScopedLock<SpinLock> lock(processingLock);
-    
-    processMidi(midiMessages);
-    
-    /** If resources are not allocated this is an out-of-order request */
-    if (!resourcesAllocated) {
-        jassertfalse;
-        return;
-    }
-    
-    
-    ScopedNoDenormals noDenormals;
-    
-    /**Apply input gain directly on input buffer  */
-    micGain.setGainDecibels(*micGainParam);
-    {
-        auto block = juce::dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(0, numActiveInputChannels);
-        auto context = juce::dsp::ProcessContextReplacing<float>(block);
-        micGain.process(context);
-    }
-    
-    // Mic meter
-    inputMeterDecay->push(buffer);
-    
-    /** Renew IIR coefficient if cut frequency changed */
-    if (prevHpfFreq != (bool) *hpfFreqParam) {
-        iirCoeffHPF = IIRCoefficients::makeHighPass(sampleRate, *hpfFreqParam);
-        prevHpfFreq = *hpfFreqParam;
-        for (auto &iirHPFfilter : iirHPFfilters) {
-            iirHPFfilter.setCoefficients(iirCoeffHPF);
-        }
-    }
-    
-    /**Apply HPF directly on input buffer  */
-    for (auto inChannel = 0; inChannel < numActiveInputChannels; ++inChannel) {
-        iirHPFfilters[inChannel].processSamples(buffer.getWritePointer(inChannel), buffer.getNumSamples());
-    }
-    
-    /** Set beams parameters */
-    for (auto beamIdx = 0; beamIdx < 2; beamIdx++) {
-        float beamDoaX = *steerBeamXParam[beamIdx];
-        float beamDoaY = -(*steerBeamYParam[beamIdx]); //GUI and Beamforming use opposite vertical conventions
-        beamDoaX = *frontFacingParam ? -beamDoaX : beamDoaX;
-        BeamParameters beamParams = {beamDoaX,beamDoaY, *widthBeamParam[beamIdx]};
-        beamformer->setBeamParameters(beamIdx, beamParams);
-    }
-    
-    /** Call the beamformer  */
-    beamformer->processBlock(buffer);
-    
-    /** Retrieve beamformer outputs */
-    beamformer->getBeams(beamBuffer);
-    
-    /** Apply beams mute and volume */
-    for (auto beamIdx = 0; beamIdx < 2; ++beamIdx) {
-        if ((bool) *muteBeamParam[beamIdx] == false) {
-            beamGain[beamIdx].setGainDecibels(*levelBeamParam[beamIdx]);
-        } else {
-            beamGain[beamIdx].setGainLinear(0);
-        }
-        auto block = dsp::AudioBlock<float>(beamBuffer).getSubsetChannelBlock(beamIdx, 1).getSubBlock(0,
-                                                                                                      buffer.getNumSamples());
-        auto contextToUse = dsp::ProcessContextReplacing<float>(block);
-        beamGain[beamIdx].process(contextToUse);
-    }
-    
-    /** Measure beam output volume */
-    beamMeterDecay->push(beamBuffer);
-    
-    /** Clear buffer */
-    buffer.clear();
-    
-    /** Sum beams in output channels */
-    for (int outChannel = 0; outChannel < numActiveOutputChannels; ++outChannel) {
-        /** Sum the contributes from each beam */
-        for (int beamIdx = 0; beamIdx < 2; ++beamIdx) {
-            auto channelBeamGain = panToLinearGain((float) *panBeamParam[beamIdx], outChannel == 0);
-            buffer.addFrom(outChannel, 0, beamBuffer, beamIdx, 0, buffer.getNumSamples(), channelBeamGain);
-        }
-    }
-    
-    /** Update load */
-    {
-        const float elapsedTime = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTick);
-        const float curLoad = elapsedTime / (maximumExpectedSamplesPerBlock / sampleRate);
-        GenericScopedLock<SpinLock> lock(loadLock);
-        load = (load * (1 - loadAlpha)) + (curLoad * loadAlpha);
-    }
-    
-}
-
-//==============================================================================
-void EbeamerAudioProcessor::getStateInformation(MemoryBlock &destData) {
-    /** Root XML */
-    std::unique_ptr<XmlElement> xml(new XmlElement("eBeamerRoot"));
-    
-    /** Parameters state */
-    auto state = parameters.copyState();
-    XmlElement *xmlParams = new XmlElement(*state.createXml());
-    xml->addChildElement(xmlParams);
-    
-    /** Save Midi CC - Params Maping */
-    auto xmlMidi = xml->createNewChildElement("eBeamerMidiMap");
-    for (auto m : paramToCcMap) {
-        auto el = xmlMidi->createNewChildElement(m.first);
-        el->setAttribute("channel", m.second.channel);
-        el->setAttribute("number", m.second.number);
-    }
-    copyXmlToBinary(*xml, destData);
-}
-
-void EbeamerAudioProcessor::setStateInformation(const void *data, int sizeInBytes) {
-    
-    std::unique_ptr<XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
-    
-    if (xmlState.get() != nullptr) {
-        if (xmlState->hasTagName("eBeamerRoot")) {
-            for (auto rootElement : xmlState->getChildIterator()){
-                if (rootElement->hasTagName(parameters.state.getType())) {
-                    /** Parameters state */
-                    parameters.replaceState(ValueTree::fromXml(*rootElement));
-                    syncParametersToValueTree();
-                } else if (rootElement->hasTagName("eBeamerMidiMap")) {
-                    /** Load Midi CC - Params Maping */
-                    ccToParamMap.clear();
-                    paramToCcMap.clear();
-                    stopCCLearning();
-                    for (auto e : rootElement->getChildIterator()){
-                        String tag = e->getTagName();
-                        int channel = e->getIntAttribute("channel");
-                        int number = e->getIntAttribute("number");
-                        insertCCParamMapping({channel, number}, tag);
-                    }
-                }
-            }
-        }
-    }
-}
-
-//==============================================================================
-// Unchanged JUCE default functions
-EbeamerAudioProcessor::~EbeamerAudioProcessor() {
-}
-
-const String EbeamerAudioProcessor::getName() const {
-    return JucePlugin_Name;
-}
-
-bool EbeamerAudioProcessor::acceptsMidi() const {
-#if JucePlugin_WantsMidiInput
-    return true;
-#else
-    return false;
-#endif
-}
-
-bool EbeamerAudioProcessor::producesMidi() const {
-#if JucePlugin_ProducesMidiOutput
-    return true;
-#else
-    return false;
-#endif
-}
-
-bool EbeamerAudioProcessor::isMidiEffect() const {
-#if JucePlugin_IsMidiEffect
-    return true;
-#else
-    return false;
-#endif
-}
-
-double EbeamerAudioProcessor::getTailLengthSeconds() const {
-    return 0.0;
-}
-
-int EbeamerAudioProcessor::getNumPrograms() {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-    // so this should be at least 1, even if you're not really implementing programs.
-}
-
-int EbeamerAudioProcessor::getCurrentProgram() {
-    return 0;
-}
-
-void EbeamerAudioProcessor::setCurrentProgram(int index) {
-}
-
-const String EbeamerAudioProcessor::getProgramName(int index) {
-    return {};
-}
-
-void EbeamerAudioProcessor::changeProgramName(int index, const String &newName) {
-}
-
-//==============================================================================
-// This creates new instances of the plugin..
-AudioProcessor *JUCE_CALLTYPE createPluginFilter() {
-    return new EbeamerAudioProcessor();
-}
-
-//==============================================================================
-AudioProcessorEditor *EbeamerAudioProcessor::createEditor() {
-    return new EBeamerAudioProcessorEditor(*this, valueTree);
-}
-
-bool EbeamerAudioProcessor::hasEditor() const {
-#ifdef HEADLESS
-    return false;
-#else
-    return true;
-#endif
-}
-
-void EbeamerAudioProcessor::showConnectionErrorMessage (const String& messageText){
-    juce::AlertWindow::showMessageBoxAsync (AlertWindow::WarningIcon,
-                                            "OSC connection error",
-                                            messageText,
-                                            "OK");
-}
-
-//==============================================================================
-
-
-/** Set a state parameter */
-void EbeamerAudioProcessor::setParam(const Identifier& name, float newVal){
-    auto param = parameters.getParameter(name);
-    auto newVal01 = param->convertTo0to1(newVal);
-    param->setValueNotifyingHost(newVal01);
-}
-
-/** Set a state parameter */
-void EbeamerAudioProcessor::setParam(const Identifier& name, bool newVal){
-    auto param = parameters.getParameter(name);
-    param->setValueNotifyingHost(newVal);
-}
-
-/** Set a state parameter */
-void EbeamerAudioProcessor::setParam(const Identifier& name, MicConfig newVal){
-    auto param = parameters.getParameter(name);
-    auto newVal01 = param->convertTo0to1(newVal);
-    param->setValueNotifyingHost(newVal01);
-}
-
-/**
- Sync parameters changes to valueTree
- */
-void EbeamerAudioProcessor::parameterChanged(const String &parameterID, float newValue) {
-    if (parameterID == configIdentifier.toString()) {
-        valueTree.setPropertyExcludingListener(this,configIdentifier, (int)newValue, nullptr);
-        prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
-        return;
-    }
-    if (parameterID == frontIdentifier.toString()){
-        valueTree.setPropertyExcludingListener(this,frontIdentifier, (bool)newValue, nullptr);
-        return;
-    }
-    if (parameterID == gainIdentifier.toString()){
-        valueTree.setPropertyExcludingListener(this,gainIdentifier, (float)newValue, nullptr);
-        return;
-    }
-    if (parameterID == hpfIdentifier.toString()){
-        valueTree.setPropertyExcludingListener(this,hpfIdentifier, (float)newValue, nullptr);
-        return;
-    }
-    String identifier;
-    for (auto beamIdx = 0; beamIdx < 2; beamIdx++) {
-        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
-            return;
-        }
-        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
-            return;
-        }
-        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
-            return;
-        }
-        identifier = (panIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
-            return;
-        }
-        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
-            return;
-        }
-        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
-        if (parameterID==identifier){
-            valueTree.setPropertyExcludingListener(this,identifier, (bool)newValue, nullptr);
-            return;
-        }
-    }
-}
-
-/**
- Sync valueTree changes to parameters
- */
-void EbeamerAudioProcessor::valueTreePropertyChanged (ValueTree &vt, const Identifier &property){
-    if (property==configIdentifier){
-        setParam(configIdentifier,static_cast<MicConfig>(int(vt[property])));
-        return;
-    }
-    if (property==frontIdentifier){
-        setParam(frontIdentifier,bool(vt[property]));
-        return;
-    }
-    if (property==gainIdentifier){
-        setParam(gainIdentifier,float(vt[property]));
-        return;
-    }
-    if (property==hpfIdentifier){
-        setParam(hpfIdentifier,float(vt[property]));
-        return;
-    }
-    Identifier identifier;
-    for (auto beamIdx = 0; beamIdx < 2; beamIdx++) {
-        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,float(vt[property]));
-            return;
-        }
-        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,float(vt[property]));
-            return;
-        }
-        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,float(vt[property]));
-            return;
-        }
-        identifier = (panIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,float(vt[property]));
-            return;
-        }
-        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,float(vt[property]));
-            return;
-        }
-        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
-        if (property==identifier){
-            setParam(identifier,bool(vt[property]));
-            return;
-        }
-    }
-}
-
-void EbeamerAudioProcessor::syncParametersToValueTree(){
-    valueTree.setPropertyExcludingListener(this,configIdentifier, (int)*configParam, nullptr);
-    valueTree.setPropertyExcludingListener(this,frontIdentifier, (bool)*frontFacingParam, nullptr);
-    valueTree.setPropertyExcludingListener(this,gainIdentifier, (float)*micGainParam, nullptr);
-    valueTree.setPropertyExcludingListener(this,hpfIdentifier, (float)*hpfFreqParam, nullptr);
-    
-    Identifier identifier;
-    for (auto beamIdx = 0; beamIdx < 2; beamIdx++) {
-        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (float)(*steerBeamXParam[beamIdx]), nullptr);
-        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (float)(*steerBeamYParam[beamIdx]), nullptr);
-        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (float)(*widthBeamParam[beamIdx]), nullptr);
-        identifier = (panIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (float)(*panBeamParam[beamIdx]), nullptr);
-        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (float)(*levelBeamParam[beamIdx]), nullptr);
-        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
-        valueTree.setPropertyExcludingListener(this,identifier, (bool)(*muteBeamParam[beamIdx]), nullptr);
-    }
-}
-
-/**
- Push cpu load, meters, energy updates at a human rate
- */
-void EbeamerAudioProcessor::timerCallback(){
-    
-    valueTree.setProperty(cpuIdentifier, load, nullptr);
-    valueTree.setProperty(outMeter1Identifier, beamMeterDecay->get(0), nullptr);
-    valueTree.setProperty(outMeter2Identifier, beamMeterDecay->get(1), nullptr);
-    valueTree.setProperty(inMetersIdentifier, inputMeterDecay->get(), nullptr);
-    valueTree.setProperty(energyIdentifier, beamformer->getDoaEnergy(), nullptr);
-    
-}
+/*
+ eBeamer Plugin Processor
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+ */
+
+#include "PluginProcessor.h"
+#include "PluginEditor.h"
+
+//==============================================================================
+
+// Helper functions
+AudioProcessorValueTreeState::ParameterLayout initializeParameters() {
+    
+    
+    std::vector<std::unique_ptr<RangedAudioParameter>> params;
+    
+    // Values in dB
+    params.push_back(std::make_unique<AudioParameterChoice>(configIdentifier.toString(), //tag
+                                                            "Configuration", //name
+                                                            micConfigLabels, //choices
+                                                            0 //default
+                                                            ));
+    
+    params.push_back(std::make_unique<AudioParameterBool>(frontIdentifier.toString(), //tag
+                                                          "Front facing", //name
+                                                          false //default
+                                                          ));
+    
+    params.push_back(std::make_unique<AudioParameterFloat>(gainIdentifier.toString(), //tag
+                                                           "Mic gain", //name
+                                                           MIN_GAIN, //min
+                                                           MAX_GAIN, //max
+                                                           DEFAULT_GAIN //default
+                                                           ));
+    
+    // Values in Hz
+    params.push_back(std::make_unique<AudioParameterFloat>(hpfIdentifier.toString(), //tag
+                                                           "HPF",
+                                                           MIN_HPF, //min
+                                                           MAX_HPF, //max
+                                                           DEFAULT_HPF //default
+                                                           ));
+    
+    params.push_back(std::make_unique<AudioParameterInt>(numBeamsIdentifier.toString(), //tag
+                                                         "Beams", //name
+                                                         1, //min
+                                                         maxNumBeams, //max
+                                                         defaultNumBeams //default
+                                                         ));
+    
+    params.push_back(std::make_unique<AudioParameterInt>(sharedInputIdentifier.toString(), //tag
+                                                         "Shared input", //name
+                                                         0, //min
+                                                         maxSharedInputGroup, //max
+                                                         0 //default
+                                                         ));
+    
+    params.push_back(std::make_unique<AudioParameterChoice>(latencyModeIdentifier.toString(), //tag
+                                                            "Latency mode", //name
+                                                            latencyModeLabels, //choices
+                                                            defaultLatencyMode //default
+                                                            ));
+    
+    params.push_back(std::make_unique<AudioParameterChoice>(internalRateIdentifier.toString(), //tag
+                                                            "Internal rate", //name
+                                                            internalRateLabels, //choices
+                                                            0 //default
+                                                            ));
+    
+    params.push_back(std::make_unique<AudioParameterBool>(beamStageIdentifier.toString(), //tag
+                                                          "Gain and HPF on beams", //name
+                                                          false //default
+                                                          ));
+    
+    {
+        for (auto beamIdx = 0; beamIdx < maxNumBeams; ++beamIdx) {
+            /** Beams beyond the first two start in front, centered */
+            auto defaultDirectionX = beamIdx == 0 ? -0.5 : beamIdx == 1 ? 0.5 : 0;
+            params.push_back(std::make_unique<AudioParameterFloat>(steerXIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                   "Steer " + String(beamIdx + 1) + " hor", //name
+                                                                   -1.0f, //min
+                                                                   1.0f, //max
+                                                                   defaultDirectionX //default
+                                                                   ));
+            
+            params.push_back(std::make_unique<AudioParameterFloat>(steerYIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                   "Steer " + String(beamIdx + 1) + " ver", //name
+                                                                   -1.0f, //min
+                                                                   1.0f, //max
+                                                                   0 //default
+                                                                   ));
+            
+            params.push_back(std::make_unique<AudioParameterFloat>(widthIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                   "Width beam" + String(beamIdx + 1), //name
+                                                                   0.0f, //min
+                                                                   1.0f,//max
+                                                                   0.3f//default
+                                                                   ));
+            
+            auto defaultPan = beamIdx == 0 ? -0.5 : beamIdx == 1 ? 0.5 : 0;
+            params.push_back(std::make_unique<AudioParameterFloat>(panIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                   "Pan beam" + String(beamIdx + 1), //name
+                                                                   -1.0f, //min
+                                                                   1.0f, //max
+                                                                   defaultPan //default
+                                                                   ));
+            
+            params.push_back(std::make_unique<AudioParameterFloat>(levelIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                   "Level beam" + String(beamIdx + 1), //name
+                                                                   MIN_LEVEL, //min
+                                                                   MAX_LEVEL, //max
+                                                                   0.0f //default
+                                                                   ));
+            
+            params.push_back(std::make_unique<AudioParameterBool>(muteIdentifierPrefix + String(beamIdx + 1), //tag
+                                                                  "Mute beam" + String(beamIdx + 1), //name
+                                                                  false //default
+                                                                  ));
+            
+        }
+    }
+    
+    return {params.begin(), params.end()};
+}
+
+
+//==============================================================================
+//The default bus layout accommodates for 4 buses of 16 channels each for VST3 mode, one bus with 64 channels for standalone mode.
+//The stereo output carries the panned mix of the beams, the optional beams bus one discrete channel for each beam.
+EbeamerAudioProcessor::EbeamerAudioProcessor()
+: AudioProcessor(JUCEApplication::isStandaloneApp()
+                 ?
+                 BusesProperties()
+                 .withInput("eSticks", AudioChannelSet::channelSetsWithNumberOfChannels(64)[0])
+                 .withOutput("Output", AudioChannelSet::stereo(), true)
+                 .withOutput("Beams", AudioChannelSet::discreteChannels(maxNumBeams), false)
+                 :
+                 BusesProperties()
+                 .withInput("eStick#1", AudioChannelSet::ambisonic(3), true)
+                 .withInput("eStick#2", AudioChannelSet::ambisonic(3), true)
+                 .withInput("eStick#3", AudioChannelSet::ambisonic(3), true)
+                 .withInput("eStick#4", AudioChannelSet::ambisonic(3), true)
+                 .withOutput("Output", AudioChannelSet::stereo(), true)
+                 .withOutput("Beams", AudioChannelSet::discreteChannels(maxNumBeams), false)
+                 ),
+parameters(*this,
+           nullptr,
+           Identifier("eBeamerParams"),
+           initializeParameters()
+           )
+{
+    
+    /** Setup parameters listener and pointers */
+    configParam = parameters.getRawParameterValue(configIdentifier.toString());
+    frontFacingParam = parameters.getRawParameterValue(frontIdentifier.toString());
+    hpfFreqParam = parameters.getRawParameterValue(hpfIdentifier.toString());
+    micGainParam = parameters.getRawParameterValue(gainIdentifier.toString());
+    numBeamsParam = parameters.getRawParameterValue(numBeamsIdentifier.toString());
+    sharedInputParam = parameters.getRawParameterValue(sharedInputIdentifier.toString());
+    latencyModeParam = parameters.getRawParameterValue(latencyModeIdentifier.toString());
+    beamStageParam = parameters.getRawParameterValue(beamStageIdentifier.toString());
+    internalRateParam = parameters.getRawParameterValue(internalRateIdentifier.toString());
+    
+    parameters.addParameterListener(configIdentifier.toString(), this);
+    parameters.addParameterListener(frontIdentifier.toString(), this);
+    parameters.addParameterListener(hpfIdentifier.toString(), this);
+    parameters.addParameterListener(gainIdentifier.toString(), this);
+    parameters.addParameterListener(numBeamsIdentifier.toString(), this);
+    parameters.addParameterListener(sharedInputIdentifier.toString(), this);
+    parameters.addParameterListener(latencyModeIdentifier.toString(), this);
+    parameters.addParameterListener(beamStageIdentifier.toString(), this);
+    parameters.addParameterListener(internalRateIdentifier.toString(), this);
+    
+    for (auto beamIdx = 0; beamIdx < maxNumBeams; beamIdx++) {
+        steerBeamXParam[beamIdx] = parameters.getRawParameterValue(steerXIdentifierPrefix + String(beamIdx + 1));
+        steerBeamYParam[beamIdx] = parameters.getRawParameterValue(steerYIdentifierPrefix + String(beamIdx + 1));
+        widthBeamParam[beamIdx] = parameters.getRawParameterValue(widthIdentifierPrefix + String(beamIdx + 1));
+        panBeamParam[beamIdx] = parameters.getRawParameterValue(panIdentifierPrefix + String(beamIdx + 1));
+        levelBeamParam[beamIdx] = parameters.getRawParameterValue(levelIdentifierPrefix + String(beamIdx + 1));
+        muteBeamParam[beamIdx] = parameters.getRawParameterValue(muteIdentifierPrefix + String(beamIdx + 1));
+        
+        parameters.addParameterListener(steerXIdentifierPrefix + String(beamIdx + 1), this);
+        parameters.addParameterListener(steerYIdentifierPrefix + String(beamIdx + 1), this);
+        parameters.addParameterListener(widthIdentifierPrefix + String(beamIdx + 1), this);
+        parameters.addParameterListener(panIdentifierPrefix + String(beamIdx + 1), this);
+        parameters.addParameterListener(levelIdentifierPrefix + String(beamIdx + 1), this);
+        parameters.addParameterListener(muteIdentifierPrefix + String(beamIdx + 1), this);
+    }
+    
+    /* Value tree for session parameters */
+    valueTree = ValueTree("Ebeamer");
+    initValueTreeParameters(valueTree);
+    valueTree.setProperty(serverPortIdentifier, 0, nullptr);
+    valueTree.setProperty(capsuleRoutingIdentifier, String(), nullptr);
+    valueTree.setProperty(traceEnabledIdentifier, TraceRecorder::getInstance().isEnabled(), nullptr);
+    valueTree.setProperty(traceDumpIdentifier, false, nullptr);
+    valueTree.setProperty(traceFileIdentifier, String(), nullptr);
+    valueTree.setProperty(perfCountersIdentifier, PerfCounters::isEnabled(), nullptr);
+    valueTree.setProperty(beamformerWorkersIdentifier, 0, nullptr);
+    
+    syncParametersToValueTree();
+    
+    /** Listen to valueTree to keep in sync with parameters */
+    valueTree.addListener(this);
+    
+    //==============================================================================
+    /* OSC controller */
+    oscController.init(valueTree);
+    registerCommonOscParameters(oscController);
+    if (oscController.startReceiver()){
+        valueTree.setProperty(serverPortIdentifier, oscController.getReceiverPort(), nullptr);
+        oscController.startBroadcast();
+    }else{
+        std::ostringstream errMsg;
+        errMsg << "Error: cannot initialize OSC receiver";
+        showConnectionErrorMessage (errMsg.str());
+    }
+    
+}
+
+//==============================================================================
+bool EbeamerAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const {
+    if (!JUCEApplication::isStandaloneApp()){
+        // This plug-in supports up to 4 eSticks, for a total amount of 64 channels in input.
+        // VST3 allows for a maximum of 25 channels per bus.
+        // To make things simpler in terms of patching, for VST each input bus counts for at most 16 channels.
+        // This configuration allows REAPER to be configured with a 64 channels track.
+        
+        for (auto bus : layouts.inputBuses) {
+            if (bus.size() > 16) {
+                return false;
+            }
+        }
+        for (auto bus : layouts.outputBuses) {
+            if (bus.size() > 16) {
+                // We have to allow the output bus to grow to the size of the input bus for compatibility with REAPER
+                return false;
+            }
+        }
+    }
+    
+    if ((layouts.getMainInputChannels() < 1) || (layouts.getMainOutputChannels() < 2)) {
+        // In any case don't allow less than 1 input and 2 output channels
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+void EbeamerAudioProcessor::prepareToPlay(double sampleRate_, int maximumExpectedSamplesPerBlock_) {
+    
+    GenericScopedLock<SpinLock> lock(processingLock);
+    
+    prepareTicks = Time::getHighResolutionTicks();
+    timeToFirstAudio = -1;
+    profiler.reset();
+    
+    stopTimer();
+    
+    clearEngines();
+    
+    sampleRate = sampleRate_;
+    maximumExpectedSamplesPerBlock = maximumExpectedSamplesPerBlock_;
+    
+    /** Number of active input channels */
+    numActiveInputChannels = getTotalNumInputChannels();
+    
+    /** Number of active output channels, the discrete beams bus is handled separately */
+    numActiveOutputChannels = jmin(2, getMainBusNumOutputChannels());
+    
+    /** Number of active beams. The beams' buffers are allocated for all of them, a new number is picked by rebuilding */
+    numBeams = jlimit(1, maxNumBeams, (int) *numBeamsParam);
+    numBeamChannels = numBeams;
+    
+    /** Capsules of any configuration, each read from its host channel */
+    maxNumCapsules = 0;
+    for (auto configIdx = 0; configIdx < micConfigLabels.size(); configIdx++) {
+        maxNumCapsules = jmax(maxNumCapsules, Beamformer::getNumMic(static_cast<MicConfig>(configIdx)));
+    }
+    updateCapsuleChannels();
+    
+    /** Initialize the hop FIFOs, the resamplers and the stages for the latency mode and the internal rate */
+    {
+        HopFormat format;
+        prepareHopFormat(format, getHopSizeParam(), getResamplingFactorParam());
+        swapHopFormat(format);
+    }
+    hopFill = 0;
+    beamStageActive = *beamStageParam;
+    
+    /** Initialize the beamformer, unless the current one fits already.
+     The beamformer always processes one hop, one built for longer hops would process it at a higher cost.
+     */
+    const auto config = static_cast<MicConfig>((int) *configParam);
+    if (beamformer == nullptr || !beamformer->canReuse(numBeams, config, processingRate, hopSize) ||
+        beamformer->getMaximumExpectedSamplesPerBlock() != hopSize || beamformer->getNumWorkers() != beamformerWorkers) {
+        activeBeamformer = nullptr;
+        beamformer = std::make_unique<Beamformer>(numBeams, config, processingRate, hopSize, metersUpdateRate,
+                                                  beamformerWorkers);
+    }
+    
+    /** Join the shared input group, if any */
+    const int sharedInputGroup = (int) *sharedInputParam;
+    if (sharedInputGroup > 0) {
+        sharedInput = SharedInput::get({sharedInputGroup, config, processingRate,
+                                        beamformer->getMaximumExpectedSamplesPerBlock(),
+                                        maxNumCapsules, beamStageActive}, *micGainParam, *hpfFreqParam);
+    } else {
+        sharedInput.reset();
+    }
+    sharedInputSequence = 0;
+    beamformer->setSharedInput(sharedInput);
+    activeBeamformer = beamformer.get();
+    numCapsules = Beamformer::getNumMic(beamformer->getMicConfig());
+    
+    setLatencySamples(getProcessingLatency());
+    
+    /** Initialize beams' buffer  */
+    beamBuffer.setSize(maxNumBeams, maximumExpectedSamplesPerBlock);
+    beamBuffer.clear();
+    
+    /** Initialize beam level gains */
+    beamGain.resize(maxNumBeams);
+    for (auto beamIdx = 0; beamIdx < maxNumBeams; ++beamIdx) {
+        beamGain[beamIdx].reset();
+        beamGain[beamIdx].prepare({sampleRate, static_cast<uint32>(maximumExpectedSamplesPerBlock), 1});
+        beamGain[beamIdx].setGainDecibels(*levelBeamParam[beamIdx]);
+        beamGain[beamIdx].setRampDurationSeconds(gainTimeConst);
+    }
+    
+    /** initialize meters */
+    inputPeaks.resize(maxNumCapsules);
+    beamMeterDecay = std::make_unique<MeterDecay>(sampleRate, metersDecay, maximumExpectedSamplesPerBlock, maxNumBeams);
+    
+    resourcesAllocated = true;
+    
+    /** Time constants */
+    loadAlpha = 1 - exp(-(maximumExpectedSamplesPerBlock / sampleRate) / loadTimeConst);
+    
+    startTimerHz(metersUpdateRate);
+}
+
+void EbeamerAudioProcessor::releaseResources() {
+    
+    GenericScopedLock<SpinLock> lock(processingLock);
+    
+    resourcesAllocated = false;
+    
+    clearEngines();
+    
+    /** Clear beam buffer */
+    beamBuffer.setSize(maxNumBeams, 0);
+    fadingBeamBuffer.setSize(maxNumBeams, 0);
+    hopInput.setSize(maxNumCapsules, 0);
+    hopBeams.setSize(maxNumBeams, 0);
+    engineInput.setSize(maxNumCapsules, 0);
+    engineBeams.setSize(maxNumBeams, 0);
+    
+    /** Clear the Beamformer, then leave the shared input group */
+    activeBeamformer = nullptr;
+    beamformer.reset();
+    sharedInput.reset();
+}
+
+void EbeamerAudioProcessor::rebuildBeamformer() {
+    
+    const auto config = static_cast<MicConfig>((int) *configParam);
+    const auto engineNumBeams = jlimit(1, maxNumBeams, (int) *numBeamsParam);
+    const auto engineResamplingFactor = getResamplingFactorParam();
+    const float engineRate = sampleRate / engineResamplingFactor;
+    const auto engineHopSize = getHopSizeParam();
+    const bool reformat = engineHopSize != hopSize || engineResamplingFactor != resamplingFactor;
+    const bool engineBeamStage = *beamStageParam;
+    
+    builderPool.addJob([this, config, engineNumBeams, engineRate, engineHopSize, engineResamplingFactor, reformat,
+                        engineBeamStage]() {
+        auto engine = std::make_unique<BeamformerEngine>();
+        engine->beamStage = engineBeamStage;
+        if (reformat) {
+            engine->format = std::make_unique<HopFormat>();
+            prepareHopFormat(*engine->format, engineHopSize, engineResamplingFactor);
+        }
+        engine->beamformer = std::make_unique<Beamformer>(engineNumBeams, config, engineRate, engineHopSize,
+                                                          metersUpdateRate, beamformerWorkers);
+        const int sharedInputGroup = (int) *sharedInputParam;
+        if (sharedInputGroup > 0) {
+            engine->sharedInput = SharedInput::get({sharedInputGroup, config, engineRate, engineHopSize,
+                                                    maxNumCapsules, engineBeamStage}, *micGainParam, *hpfFreqParam);
+            engine->beamformer->setSharedInput(engine->sharedInput);
+        }
+        
+        /** Design the filters for the current beams, so that the engine fades in with its final beams.
+         The requests are renewed while waiting, a request made while the designer reads them is dropped
+         */
+        while (!engine->beamformer->areBeamsDesigned()) {
+            if (ThreadPoolJob::getCurrentThreadPoolJob()->shouldExit()) {
+                return;
+            }
+            for (auto beamIdx = 0; beamIdx < engineNumBeams; beamIdx++) {
+                float beamDoaX = *steerBeamXParam[beamIdx];
+                float beamDoaY = -(*steerBeamYParam[beamIdx]);
+                beamDoaX = *frontFacingParam ? -beamDoaX : beamDoaX;
+                engine->beamformer->setBeamParameters(beamIdx, {beamDoaX, beamDoaY, *widthBeamParam[beamIdx]});
+            }
+            Thread::sleep(5);
+        }
+        
+        /** Publish, replacing an engine not picked up yet. The last request wins, either a crossfade or a new format */
+        if (reformat) {
+            delete pendingEngine.exchange(nullptr);
+            delete reformatEngine.exchange(engine.release());
+        } else {
+            delete reformatEngine.exchange(nullptr);
+            delete pendingEngine.exchange(engine.release());
+        }
+    });
+}
+
+void EbeamerAudioProcessor::prepareHopFormat(HopFormat &format, int newHopSize, int newResamplingFactor) const {
+    
+    /** Internal processing rate, an integer fraction of the host rate */
+    format.resamplingFactor = newResamplingFactor;
+    format.processingRate = sampleRate / newResamplingFactor;
+    
+    /** Hop FIFOs. The beams are output one hop late */
+    format.hopSize = newHopSize;
+    format.hostHopSize = newHopSize * newResamplingFactor;
+    format.hopInput.setSize(maxNumCapsules, format.hostHopSize);
+    format.hopInput.clear();
+    format.hopBeams.setSize(maxNumBeams, format.hostHopSize);
+    format.hopBeams.clear();
+    
+    /** Resamplers, or the FIFOs processed in place */
+    if (newResamplingFactor > 1) {
+        format.capsuleDecimator.prepare(newResamplingFactor, maxNumCapsules, newHopSize);
+        format.beamInterpolator.prepare(newResamplingFactor, maxNumBeams, newHopSize);
+        format.engineInput.setSize(maxNumCapsules, newHopSize);
+        format.engineBeams.setSize(maxNumBeams, newHopSize);
+    } else {
+        format.engineInput.setDataToReferTo(format.hopInput.getArrayOfWritePointers(), maxNumCapsules, newHopSize);
+        format.engineBeams.setDataToReferTo(format.hopBeams.getArrayOfWritePointers(), maxNumBeams, newHopSize);
+    }
+    
+    /** Input gain and High Pass Filters, on the microphones or on the beams */
+    format.inputStage.prepare(format.processingRate, newHopSize, maxNumCapsules, *micGainParam);
+    format.beamStage.prepare(format.processingRate, newHopSize, maxNumBeams, *micGainParam);
+    
+    format.fadingBeamBuffer.setSize(maxNumBeams, newHopSize);
+    format.crossfadeSamples = jmax(1, roundToInt(crossfadeTime * format.processingRate));
+    format.inputMeterDecay = std::make_unique<MeterDecay>(format.processingRate, metersDecay, newHopSize,
+                                                          maxNumCapsules);
+}
+
+void EbeamerAudioProcessor::swapHopFormat(HopFormat &format) {
+    std::swap(hopSize, format.hopSize);
+    std::swap(hostHopSize, format.hostHopSize);
+    std::swap(resamplingFactor, format.resamplingFactor);
+    std::swap(processingRate, format.processingRate);
+    std::swap(hopInput, format.hopInput);
+    std::swap(hopBeams, format.hopBeams);
+    std::swap(engineInput, format.engineInput);
+    std::swap(engineBeams, format.engineBeams);
+    std::swap(fadingBeamBuffer, format.fadingBeamBuffer);
+    std::swap(capsuleDecimator, format.capsuleDecimator);
+    std::swap(beamInterpolator, format.beamInterpolator);
+    std::swap(inputStage, format.inputStage);
+    std::swap(beamStage, format.beamStage);
+    std::swap(inputMeterDecay, format.inputMeterDecay);
+    std::swap(crossfadeSamples, format.crossfadeSamples);
+}
+
+void EbeamerAudioProcessor::adoptReformatEngine(BeamformerEngine &engine) {
+    
+    auto &format = *engine.format;
+    
+    /** Fade out the beams of the last hop not output yet, in place of the silence the new FIFO starts with */
+    const auto numFadeSamples = jmin(hostHopSize - hopFill, format.hostHopSize);
+    for (auto beamIdx = 0; beamIdx < numBeamChannels; beamIdx++) {
+        format.hopBeams.copyFromWithRamp(beamIdx, 0, hopBeams.getReadPointer(beamIdx, hopFill), numFadeSamples,
+                                         1, 0);
+    }
+    
+    /** Keep the gain and the High Pass Filters running when the internal rate doesn't change */
+    if (format.processingRate == processingRate) {
+        format.inputStage.copyStateFrom(inputStage);
+        format.beamStage.copyStateFrom(beamStage);
+    }
+    
+    swapHopFormat(format);
+    hopFill = 0;
+    
+    std::swap(beamformer, engine.beamformer);
+    std::swap(sharedInput, engine.sharedInput);
+    std::swap(beamStageActive, engine.beamStage);
+    sharedInputSequence = 0;
+    activeBeamformer = beamformer.get();
+    numCapsules = Beamformer::getNumMic(beamformer->getMicConfig());
+    
+    /** Beams added by the new beamformer start from silence */
+    const auto prevNumBeams = numBeams;
+    numBeams = beamformer->getNumBeams();
+    numBeamChannels = jmax(numBeamChannels, numBeams);
+    for (auto beamIdx = prevNumBeams; beamIdx < numBeams; beamIdx++) {
+        beamBuffer.clear(beamIdx, 0, beamBuffer.getNumSamples());
+    }
+}
+
+int EbeamerAudioProcessor::getProcessingLatency() const {
+    /** The same for all the configurations */
+    const auto resamplingDelay = resamplingFactor > 1 ? 2 * PolyphaseResampler::getDelay(resamplingFactor) : 0;
+    return hostHopSize + resamplingFactor * beamformer->getLatency() + resamplingDelay;
+}
+
+int EbeamerAudioProcessor::getHopSizeParam() const {
+    return latencyModeHops[jlimit(0, latencyModeLabels.size() - 1, (int) *latencyModeParam)];
+}
+
+int EbeamerAudioProcessor::getResamplingFactorParam() const {
+    const auto minProcessingRate = internalRates[jlimit(0, internalRateLabels.size() - 1, (int) *internalRateParam)];
+    return minProcessingRate > 0 ? jmax(1, int(sampleRate / minProcessingRate)) : 1;
+}
+
+void EbeamerAudioProcessor::setCapsuleRouting(const String &routing) {
+    
+    std::vector<int> newRouting;
+    for (auto &channel : StringArray::fromTokens(routing, " ,", "")) {
+        newRouting.push_back(channel.getIntValue() - 1);
+    }
+    
+    GenericScopedLock<SpinLock> lock(processingLock);
+    std::swap(capsuleRouting, newRouting);
+    updateCapsuleChannels();
+}
+
+void EbeamerAudioProcessor::updateCapsuleChannels() {
+    capsuleChannels.resize(maxNumCapsules);
+    for (auto capsuleIdx = 0; capsuleIdx < maxNumCapsules; capsuleIdx++) {
+        const auto channel = capsuleIdx < int(capsuleRouting.size()) ? capsuleRouting[capsuleIdx] : capsuleIdx;
+        capsuleChannels[capsuleIdx] = isPositiveAndBelow(channel, (int) numActiveInputChannels) ? channel : -1;
+    }
+}
+
+void EbeamerAudioProcessor::clearEngines() {
+    builderPool.removeAllJobs(true, 10000);
+    delete pendingEngine.exchange(nullptr);
+    delete reformatEngine.exchange(nullptr);
+    delete retiredEngine.exchange(nullptr);
+    fadingEngine.reset();
+    crossfadeSamplesLeft = 0;
+}
+
+bool EbeamerAudioProcessor::insertCCParamMapping(const MidiCC &cc, const String &param) {
+    if (paramToCcMap.count(param) > 0 || ccToParamMap.count(cc) > 0) {
+        return false;
+    }
+    ccToParamMap[cc] = param;
+    paramToCcMap[param] = cc;
+    return true;
+}
+
+void EbeamerAudioProcessor::removeCCParamMapping(const String &param) {
+    if (paramToCcMap.count(param) > 0) {
+        auto cc = paramToCcMap[param];
+        paramToCcMap.erase(param);
+        ccToParamMap.erase(cc);
+    }
+}
+
+void EbeamerAudioProcessor::processCC(const MidiCC &cc, int value) {
+    
+    const String paramTag = ccToParamMap[cc];
+    Value val = parameters.getParameterAsValue(paramTag);
+    auto range = parameters.getParameterRange(paramTag);
+    const bool isButton = range.interval == 1 && range.start == 0 && range.end == 1;
+    if (isButton) {
+        if (value == 127) {
+            val.setValue(!((bool) val.getValue()));
+        }
+    } else {
+        val.setValue(range.convertFrom0to1(value / 127.));
+    }
+    
+}
+
+void EbeamerAudioProcessor::startCCLearning(const String &p) {
+    paramCCToLearn = p;
+}
+
+void EbeamerAudioProcessor::stopCCLearning() {
+    paramCCToLearn = "";
+}
+
+String EbeamerAudioProcessor::getCCLearning() const {
+    return paramCCToLearn;
+}
+
+const std::map<String, MidiCC> &EbeamerAudioProcessor::getParamToCCMapping() {
+    return paramToCcMap;
+}
+
+void EbeamerAudioProcessor::processMidi(MidiBuffer &midiMessages) {
+    
+    // Loop over Midi messages
+    for (const MidiMessageMetadata metadata : midiMessages){
+        MidiMessage midiMess = metadata.getMessage();
+        
+        if (midiMess.isController()) {
+            
+            MidiCC cc = {midiMess.getChannel(), midiMess.getControllerNumber()};
+            if (ccToParamMap.count(cc) > 0) {
+                /** Process the CC message if mapped */
+                processCC(cc, midiMess.getControllerValue());
+            } else if (paramCCToLearn.length() > 0) {
+                /** Remove then add the CC parameter */
+                removeCCParamMapping(paramCCToLearn);
+                insertCCParamMapping(cc, paramCCToLearn);
+            }
+        }
+    }
+    
+    /** Clear all messages */
+    midiMessages.clear();
+    
+}
+
+void EbeamerAudioProcessor::processBlock(AudioBuffer<float> &buffer, MidiBuffer &midiMessages) {
+    
+    const auto startTick = Time::getHighResolutionTicks();
+    TraceRecorder::Scope traceScope("processBlock");
+    RealtimeCheck::Scope realtimeScope;
+    
+    GenericScopedLock<SpinLock> lock(processingLock);
+    
+    processMidi(midiMessages);
+    
+    /** If resources are not allocated this is an out-of-order request */
+    if (!resourcesAllocated) {
+        jassertfalse;
+        return;
+    }
+    
+    ScopedNoDenormals noDenormals;
+    
+    /** Collect the input in hops and output the beams of the previous hop, processing each hop as soon as it is full */
+    const auto numSamples = buffer.getNumSamples();
+    for (auto sampleIdx = 0; sampleIdx < numSamples;) {
+        const auto numHopSamples = jmin(numSamples - sampleIdx, hostHopSize - hopFill);
+        for (auto capsuleIdx = 0; capsuleIdx < numCapsules; ++capsuleIdx) {
+            const auto channel = capsuleChannels[capsuleIdx];
+            if (channel >= 0) {
+                hopInput.copyFrom(capsuleIdx, hopFill, buffer, channel, sampleIdx, numHopSamples);
+            } else {
+                hopInput.clear(capsuleIdx, hopFill, numHopSamples);
+            }
+        }
+        for (auto beamIdx = 0; beamIdx < numBeams; ++beamIdx) {
+            beamBuffer.copyFrom(beamIdx, sampleIdx, hopBeams, beamIdx, hopFill, numHopSamples);
+        }
+        sampleIdx += numHopSamples;
+        hopFill += numHopSamples;
+        if (hopFill == hostHopSize) {
+            processHop();
+            hopFill = 0;
+        }
+    }
+    const auto mixStartTick = Time::getHighResolutionTicks();
+    AudioBuffer<float> blockBeams(beamBuffer.getArrayOfWritePointers(), numBeams, numSamples);
+    
+    /** Apply beams mute and volume */
+    for (auto beamIdx = 0; beamIdx < numBeams; ++beamIdx) {
+        if ((bool) *muteBeamParam[beamIdx] == false) {
+            beamGain[beamIdx].setGainDecibels(*levelBeamParam[beamIdx]);
+        } else {
+            beamGain[beamIdx].setGainLinear(0);
+        }
+        auto block = dsp::AudioBlock<float>(beamBuffer).getSubsetChannelBlock(beamIdx, 1).getSubBlock(0,
+                                                                                                      buffer.getNumSamples());
+        auto contextToUse = dsp::ProcessContextReplacing<float>(block);
+        beamGain[beamIdx].process(contextToUse);
+    }
+    
+    /** Measure beam output volume */
+    beamMeterDecay->push(blockBeams);
+    
+    /** Clear buffer */
+    buffer.clear();
+    
+    /** Sum beams in output channels */
+    for (int outChannel = 0; outChannel < numActiveOutputChannels; ++outChannel) {
+        /** Sum the contributes from each beam */
+        for (int beamIdx = 0; beamIdx < numBeams; ++beamIdx) {
+            auto channelBeamGain = panToLinearGain((float) *panBeamParam[beamIdx], outChannel == 0);
+            buffer.addFrom(outChannel, 0, beamBuffer, beamIdx, 0, buffer.getNumSamples(), channelBeamGain);
+        }
+    }
+    
+    /** Copy each beam in its own channel of the discrete beams bus, if enabled */
+    if (getBusCount(false) > 1) {
+        auto beamsBuffer = getBusBuffer(buffer, false, 1);
+        for (int beamIdx = 0; beamIdx < jmin(numBeams, beamsBuffer.getNumChannels()); ++beamIdx) {
+            beamsBuffer.copyFrom(beamIdx, 0, beamBuffer, beamIdx, 0, buffer.getNumSamples());
+        }
+    }
+    
+    profiler.record(StageProfiler::outputMix, mixStartTick, numSamples / sampleRate);
+    
+    /** Update load */
+    {
+        const float elapsedTime = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTick);
+        const float curLoad = elapsedTime / (numSamples / sampleRate);
+        if (curLoad > 1) {
+            TraceRecorder::getInstance().requestDump();
+        }
+        GenericScopedLock<SpinLock> lock(loadLock);
+        load = (load * (1 - loadAlpha)) + (curLoad * loadAlpha);
+    }
+    
+}
+
+void EbeamerAudioProcessor::processHop() {
+    
+    TraceRecorder::Scope traceScope("processHop");
+    
+    /** Swap in a new beamformer, if ready, and fade out the active one */
+    if (fadingEngine == nullptr && retiredEngine.load() == nullptr) {
+        if (auto nextEngine = pendingEngine.exchange(nullptr)) {
+            fadingEngine.reset(nextEngine);
+            std::swap(beamformer, fadingEngine->beamformer);
+            std::swap(sharedInput, fadingEngine->sharedInput);
+            /** Both engines process the same capsules and the beam stage applies to their mix, so the input stage
+             moves at once
+             */
+            std::swap(beamStageActive, fadingEngine->beamStage);
+            sharedInputSequence = 0;
+            fadingEngine->beamformer->setSharedInput(nullptr);
+            activeBeamformer = beamformer.get();
+            crossfadeSamplesLeft = crossfadeSamples;
+            
+            /** Both engines' beams are output until the end of the crossfade. The beams added start from silence */
+            const auto prevNumBeams = numBeams;
+            numBeams = jmax(numBeams, beamformer->getNumBeams());
+            numBeamChannels = jmax(numBeamChannels, numBeams);
+            for (auto beamIdx = prevNumBeams; beamIdx < numBeams; beamIdx++) {
+                beamBuffer.clear(beamIdx, 0, beamBuffer.getNumSamples());
+            }
+            
+            /** Both engines need their capsules until the end of the crossfade. The new ones start from silence */
+            const auto prevNumCapsules = numCapsules;
+            numCapsules = jmax(numCapsules, Beamformer::getNumMic(beamformer->getMicConfig()));
+            for (auto capsuleIdx = prevNumCapsules; capsuleIdx < numCapsules; capsuleIdx++) {
+                hopInput.clear(capsuleIdx, 0, hostHopSize);
+            }
+        }
+    }
+    
+    const auto inputStartTick = Time::getHighResolutionTicks();
+    
+    /** Capsules of the engines at the internal rate, in the first numCapsules channels of engineInput.
+     The other channels are not processed, the engines read only their own capsules
+     */
+    if (resamplingFactor > 1) {
+        capsuleDecimator.process(hopInput, engineInput, numCapsules);
+    }
+    
+    /** With a shared input, only the first instance processing this hop runs the input stage */
+    auto claim = SharedInput::Claim::claimed;
+    if (sharedInput != nullptr) {
+        sharedInput->setStageParameters(beamformer.get(), *micGainParam, *hpfFreqParam);
+        claim = sharedInput->claimBlock(SharedInput::getSignature(engineInput, numCapsules), sharedInputSequence);
+    }
+    const bool inputClaimed = claim != SharedInput::Claim::published;
+    
+    if (inputClaimed && !beamStageActive) {
+        /** Apply input gain and HPF directly on input buffer, measuring the mic meters on the way.
+         With a shared input, the group's gain and HPF are those of the DOA owner. A block another instance is late to
+         publish goes through the private stage, continuing from the shared one, which is in use
+         */
+        if (sharedInput == nullptr) {
+            inputStage.process(engineInput, numCapsules, *micGainParam, *hpfFreqParam, inputPeaks.data());
+        } else if (claim == SharedInput::Claim::claimed) {
+            sharedInput->processInputStage(engineInput, numCapsules, inputPeaks.data());
+        } else {
+            sharedInput->processInputStage(inputStage, engineInput, numCapsules, inputPeaks.data());
+        }
+    } else {
+        // Mic meter. When the input has been processed by another instance, or the input stage is applied to the
+        // beams, the meter shows the input before the gain
+        for (auto capsuleIdx = 0; capsuleIdx < numCapsules; capsuleIdx++) {
+            inputPeaks[capsuleIdx] = engineInput.getMagnitude(capsuleIdx, 0, hopSize);
+        }
+    }
+    inputMeterDecay->push(inputPeaks.data(), numCapsules);
+    profiler.record(StageProfiler::inputStage, inputStartTick, hopSize / processingRate);
+    
+    /** Set beams parameters */
+    for (auto beamIdx = 0; beamIdx < beamformer->getNumBeams(); beamIdx++) {
+        float beamDoaX = *steerBeamXParam[beamIdx];
+        float beamDoaY = -(*steerBeamYParam[beamIdx]); //GUI and Beamforming use opposite vertical conventions
+        beamDoaX = *frontFacingParam ? -beamDoaX : beamDoaX;
+        BeamParameters beamParams = {beamDoaX,beamDoaY, *widthBeamParam[beamIdx]};
+        beamformer->setBeamParameters(beamIdx, beamParams);
+    }
+    
+    /** Call the beamformer  */
+    if (inputClaimed) {
+        beamformer->processBlock(engineInput, claim == SharedInput::Claim::claimed);
+    } else {
+        beamformer->processSharedBlock();
+    }
+    
+    /** Retrieve beamformer outputs, silent on the channels beyond its beams */
+    AudioBuffer<float> beams(engineBeams.getArrayOfWritePointers(), numBeamChannels, hopSize);
+    beamformer->getBeams(beams);
+    
+    if (timeToFirstAudio < 0 && beamformer->areBeamsReady()) {
+        timeToFirstAudio = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - prepareTicks);
+    }
+    
+    /** Crossfade from the previous beamformer, then hand it over to the message thread */
+    if (fadingEngine != nullptr) {
+        if (!inputClaimed) {
+            /** Same input as the active engine, processed by the instance that claimed it.
+             Capsules beyond the shared configuration are left as they are
+             */
+            sharedInput->getBlock(engineInput);
+        }
+        fadingEngine->beamformer->processBlock(engineInput);
+        AudioBuffer<float> fadingBeams(fadingBeamBuffer.getArrayOfWritePointers(), numBeams, hopSize);
+        fadingEngine->beamformer->getBeams(fadingBeams);
+        const auto numSamples = jmin(hopSize, crossfadeSamplesLeft);
+        const float fadeStart = float(crossfadeSamplesLeft) / crossfadeSamples;
+        const float fadeEnd = float(crossfadeSamplesLeft - numSamples) / crossfadeSamples;
+        for (auto beamIdx = 0; beamIdx < numBeams; ++beamIdx) {
+            beams.applyGainRamp(beamIdx, 0, numSamples, 1 - fadeStart, 1 - fadeEnd);
+            beams.addFromWithRamp(beamIdx, 0, fadingBeams.getReadPointer(beamIdx), numSamples, fadeStart, fadeEnd);
+        }
+        crossfadeSamplesLeft -= numSamples;
+        if (crossfadeSamplesLeft == 0) {
+            retiredEngine = fadingEngine.release();
+            numCapsules = Beamformer::getNumMic(beamformer->getMicConfig());
+            numBeams = beamformer->getNumBeams();
+        }
+    }
+    
+    /** Apply input gain and HPF to the beams, when moved after the beamformer */
+    if (beamStageActive) {
+        beamStage.process(beams, numBeamChannels, *micGainParam, *hpfFreqParam);
+    }
+    
+    /** Back to the host rate */
+    if (resamplingFactor > 1) {
+        AudioBuffer<float> hostBeams(hopBeams.getArrayOfWritePointers(), numBeamChannels, hostHopSize);
+        beamInterpolator.process(beams, hostBeams);
+    }
+}
+
+//==============================================================================
+void EbeamerAudioProcessor::getStateInformation(MemoryBlock &destData) {
+    /** Root XML */
+    std::unique_ptr<XmlElement> xml(new XmlElement("eBeamerRoot"));
+    
+    /** Parameters state */
+    auto state = parameters.copyState();
+    XmlElement *xmlParams = new XmlElement(*state.createXml());
+    xml->addChildElement(xmlParams);
+    
+    /** Save capsule routing */
+    xml->createNewChildElement("eBeamerCapsuleRouting")->setAttribute("channels",
+                                                                       valueTree[capsuleRoutingIdentifier].toString());
+    
+    /** Save beamformer workers */
+    xml->createNewChildElement("eBeamerWorkers")->setAttribute("count", int(valueTree[beamformerWorkersIdentifier]));
+    
+    /** Save Midi CC - Params Maping */
+    auto xmlMidi = xml->createNewChildElement("eBeamerMidiMap");
+    for (auto m : paramToCcMap) {
+        auto el = xmlMidi->createNewChildElement(m.first);
+        el->setAttribute("channel", m.second.channel);
+        el->setAttribute("number", m.second.number);
+    }
+    copyXmlToBinary(*xml, destData);
+}
+
+void EbeamerAudioProcessor::setStateInformation(const void *data, int sizeInBytes) {
+    
+    std::unique_ptr<XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+    
+    if (xmlState.get() != nullptr) {
+        if (xmlState->hasTagName("eBeamerRoot")) {
+            for (auto rootElement : xmlState->getChildIterator()){
+                if (rootElement->hasTagName(parameters.state.getType())) {
+                    /** Parameters state */
+                    parameters.replaceState(ValueTree::fromXml(*rootElement));
+                    syncParametersToValueTree();
+                } else if (rootElement->hasTagName("eBeamerCapsuleRouting")) {
+                    /** Load capsule routing */
+                    valueTree.setProperty(capsuleRoutingIdentifier, rootElement->getStringAttribute("channels"),
+                                          nullptr);
+                } else if (rootElement->hasTagName("eBeamerWorkers")) {
+                    /** Load beamformer workers */
+                    valueTree.setProperty(beamformerWorkersIdentifier, rootElement->getIntAttribute("count"), nullptr);
+                } else if (rootElement->hasTagName("eBeamerMidiMap")) {
+                    /** Load Midi CC - Params Maping */
+                    ccToParamMap.clear();
+                    paramToCcMap.clear();
+                    stopCCLearning();
+                    for (auto e : rootElement->getChildIterator()){
+                        String tag = e->getTagName();
+                        int channel = e->getIntAttribute("channel");
+                        int number = e->getIntAttribute("number");
+                        insertCCParamMapping({channel, number}, tag);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// Unchanged JUCE default functions
+EbeamerAudioProcessor::~EbeamerAudioProcessor() {
+    clearEngines();
+}
+
+const String EbeamerAudioProcessor::getName() const {
+    return JucePlugin_Name;
+}
+
+bool EbeamerAudioProcessor::acceptsMidi() const {
+#if JucePlugin_WantsMidiInput
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool EbeamerAudioProcessor::producesMidi() const {
+#if JucePlugin_ProducesMidiOutput
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool EbeamerAudioProcessor::isMidiEffect() const {
+#if JucePlugin_IsMidiEffect
+    return true;
+#else
+    return false;
+#endif
+}
+
+double EbeamerAudioProcessor::getTailLengthSeconds() const {
+    return 0.0;
+}
+
+int EbeamerAudioProcessor::getNumPrograms() {
+    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+    // so this should be at least 1, even if you're not really implementing programs.
+}
+
+int EbeamerAudioProcessor::getCurrentProgram() {
+    return 0;
+}
+
+void EbeamerAudioProcessor::setCurrentProgram(int index) {
+}
+
+const String EbeamerAudioProcessor::getProgramName(int index) {
+    return {};
+}
+
+void EbeamerAudioProcessor::changeProgramName(int index, const String &newName) {
+}
+
+//==============================================================================
+// This creates new instances of the plugin..
+AudioProcessor *JUCE_CALLTYPE createPluginFilter() {
+    return new EbeamerAudioProcessor();
+}
+
+//==============================================================================
+AudioProcessorEditor *EbeamerAudioProcessor::createEditor() {
+    return new EBeamerAudioProcessorEditor(*this, valueTree);
+}
+
+bool EbeamerAudioProcessor::hasEditor() const {
+#ifdef HEADLESS
+    return false;
+#else
+    return true;
+#endif
+}
+
+void EbeamerAudioProcessor::showConnectionErrorMessage (const String& messageText){
+    juce::AlertWindow::showMessageBoxAsync (AlertWindow::WarningIcon,
+                                            "OSC connection error",
+                                            messageText,
+                                            "OK");
+}
+
+//==============================================================================
+
+
+/** Set a state parameter */
+void EbeamerAudioProcessor::setParam(const Identifier& name, float newVal){
+    auto param = parameters.getParameter(name);
+    auto newVal01 = param->convertTo0to1(newVal);
+    param->setValueNotifyingHost(newVal01);
+}
+
+/** Set a state parameter */
+void EbeamerAudioProcessor::setParam(const Identifier& name, bool newVal){
+    auto param = parameters.getParameter(name);
+    param->setValueNotifyingHost(newVal);
+}
+
+/** Set a state parameter */
+void EbeamerAudioProcessor::setParam(const Identifier& name, MicConfig newVal){
+    auto param = parameters.getParameter(name);
+    auto newVal01 = param->convertTo0to1(newVal);
+    param->setValueNotifyingHost(newVal01);
+}
+
+/**
+ Sync parameters changes to valueTree
+ */
+void EbeamerAudioProcessor::parameterChanged(const String &parameterID, float newValue) {
+    if (parameterID == configIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,configIdentifier, (int)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    if (parameterID == frontIdentifier.toString()){
+        valueTree.setPropertyExcludingListener(this,frontIdentifier, (bool)newValue, nullptr);
+        return;
+    }
+    if (parameterID == gainIdentifier.toString()){
+        valueTree.setPropertyExcludingListener(this,gainIdentifier, (float)newValue, nullptr);
+        return;
+    }
+    if (parameterID == hpfIdentifier.toString()){
+        valueTree.setPropertyExcludingListener(this,hpfIdentifier, (float)newValue, nullptr);
+        return;
+    }
+    if (parameterID == numBeamsIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,numBeamsIdentifier, (int)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    if (parameterID == sharedInputIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,sharedInputIdentifier, (int)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    if (parameterID == latencyModeIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,latencyModeIdentifier, (int)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    if (parameterID == internalRateIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,internalRateIdentifier, (int)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    if (parameterID == beamStageIdentifier.toString()) {
+        valueTree.setPropertyExcludingListener(this,beamStageIdentifier, (bool)newValue, nullptr);
+        if (resourcesAllocated) {
+            rebuildBeamformer();
+        }
+        return;
+    }
+    String identifier;
+    for (auto beamIdx = 0; beamIdx < maxNumBeams; beamIdx++) {
+        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
+            return;
+        }
+        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
+            return;
+        }
+        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
+            return;
+        }
+        identifier = (panIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
+            return;
+        }
+        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (float)newValue, nullptr);
+            return;
+        }
+        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
+        if (parameterID==identifier){
+            valueTree.setPropertyExcludingListener(this,identifier, (bool)newValue, nullptr);
+            return;
+        }
+    }
+}
+
+/**
+ Sync valueTree changes to parameters
+ */
+void EbeamerAudioProcessor::valueTreePropertyChanged (ValueTree &vt, const Identifier &property){
+    if (property==configIdentifier){
+        setParam(configIdentifier,static_cast<MicConfig>(int(vt[property])));
+        return;
+    }
+    if (property==frontIdentifier){
+        setParam(frontIdentifier,bool(vt[property]));
+        return;
+    }
+    if (property==gainIdentifier){
+        setParam(gainIdentifier,float(vt[property]));
+        return;
+    }
+    if (property==hpfIdentifier){
+        setParam(hpfIdentifier,float(vt[property]));
+        return;
+    }
+    if (property==numBeamsIdentifier){
+        setParam(numBeamsIdentifier,float(int(vt[property])));
+        return;
+    }
+    if (property==sharedInputIdentifier){
+        setParam(sharedInputIdentifier,float(int(vt[property])));
+        return;
+    }
+    if (property==latencyModeIdentifier){
+        setParam(latencyModeIdentifier,float(int(vt[property])));
+        return;
+    }
+    if (property==internalRateIdentifier){
+        setParam(internalRateIdentifier,float(int(vt[property])));
+        return;
+    }
+    if (property==beamStageIdentifier){
+        setParam(beamStageIdentifier,bool(vt[property]));
+        return;
+    }
+    if (property==capsuleRoutingIdentifier){
+        setCapsuleRouting(vt[property].toString());
+        return;
+    }
+    if (property==traceEnabledIdentifier){
+        TraceRecorder::getInstance().setEnabled(bool(vt[property]));
+        return;
+    }
+    if (property==perfCountersIdentifier){
+        PerfCounters::setEnabled(bool(vt[property]));
+        return;
+    }
+    if (property==beamformerWorkersIdentifier){
+        const auto numWorkers = jlimit(0, jmax(0, SystemStats::getNumCpus() - 1), int(vt[property]));
+        if (numWorkers != int(vt[property])) {
+            vt.setProperty(beamformerWorkersIdentifier, numWorkers, nullptr);
+        } else if (numWorkers != beamformerWorkers) {
+            beamformerWorkers = numWorkers;
+            if (resourcesAllocated) {
+                rebuildBeamformer();
+            }
+        }
+        return;
+    }
+    if (property==traceDumpIdentifier){
+        if (bool(vt[property])){
+            dumpTrace();
+            vt.setProperty(traceDumpIdentifier, false, nullptr);
+        }
+        return;
+    }
+    Identifier identifier;
+    for (auto beamIdx = 0; beamIdx < maxNumBeams; beamIdx++) {
+        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,float(vt[property]));
+            return;
+        }
+        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,float(vt[property]));
+            return;
+        }
+        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,float(vt[property]));
+            return;
+        }
+        identifier = (panIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,float(vt[property]));
+            return;
+        }
+        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,float(vt[property]));
+            return;
+        }
+        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
+        if (property==identifier){
+            setParam(identifier,bool(vt[property]));
+            return;
+        }
+    }
+}
+
+void EbeamerAudioProcessor::syncParametersToValueTree(){
+    valueTree.setPropertyExcludingListener(this,configIdentifier, (int)*configParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,frontIdentifier, (bool)*frontFacingParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,gainIdentifier, (float)*micGainParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,hpfIdentifier, (float)*hpfFreqParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,numBeamsIdentifier, (int)*numBeamsParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,sharedInputIdentifier, (int)*sharedInputParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,latencyModeIdentifier, (int)*latencyModeParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,internalRateIdentifier, (int)*internalRateParam, nullptr);
+    valueTree.setPropertyExcludingListener(this,beamStageIdentifier, (bool)*beamStageParam, nullptr);
+    
+    Identifier identifier;
+    for (auto beamIdx = 0; beamIdx < maxNumBeams; beamIdx++) {
+        identifier = (steerXIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (float)(*steerBeamXParam[beamIdx]), nullptr);
+        identifier = (steerYIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (float)(*steerBeamYParam[beamIdx]), nullptr);
+        identifier = (widthIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (float)(*widthBeamParam[beamIdx]), nullptr);
+        identifier = (panIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (float)(*panBeamParam[beamIdx]), nullptr);
+        identifier = (levelIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (float)(*levelBeamParam[beamIdx]), nullptr);
+        identifier = (muteIdentifierPrefix + String(beamIdx + 1));
+        valueTree.setPropertyExcludingListener(this,identifier, (bool)(*muteBeamParam[beamIdx]), nullptr);
+    }
+}
+
+/**
+ Push cpu load, meters, energy updates at a human rate
+ */
+void EbeamerAudioProcessor::timerCallback(){
+    
+    TraceRecorder::Scope traceScope("timerCallback");
+    
+    /** Destroy the beamformer faded out by the audio thread */
+    delete retiredEngine.exchange(nullptr);
+    
+    /** Switch to the format of a beamformer built in background, reporting the new latency.
+     Only pointers are exchanged under the lock, the previous beamformer and format are destroyed here
+     */
+    if (std::unique_ptr<BeamformerEngine> engine{reformatEngine.exchange(nullptr)}) {
+        /** A crossfade in progress is dropped, the engine being faded out is destroyed here as well */
+        std::unique_ptr<BeamformerEngine> droppedEngine;
+        int latency = -1;
+        {
+            GenericScopedLock<SpinLock> lock(processingLock);
+            if (resourcesAllocated) {
+                droppedEngine = std::move(fadingEngine);
+                crossfadeSamplesLeft = 0;
+                adoptReformatEngine(*engine);
+                latency = getProcessingLatency();
+            }
+        }
+        if (latency >= 0) {
+            setLatencySamples(latency);
+        }
+    }
+    
+    valueTree.setProperty(cpuIdentifier, load, nullptr);
+    valueTree.setProperty(latencySamplesIdentifier, getLatencySamples(), nullptr);
+    valueTree.setProperty(outMeter1Identifier, beamMeterDecay->get(0), nullptr);
+    valueTree.setProperty(outMeter2Identifier, (int) *numBeamsParam > 1 ? beamMeterDecay->get(1) : 0.f, nullptr);
+    valueTree.setProperty(inMetersIdentifier, inputMeterDecay->get(), nullptr);
+    if (auto bf = activeBeamformer.load()) {
+        valueTree.setProperty(energyIdentifier, bf->getDoaEnergy(), nullptr);
+        valueTree.setProperty(doaReadyIdentifier, bf->isDoaReady(), nullptr);
+    }
+    if (timeToFirstAudio >= 0) {
+        valueTree.setProperty(timeToFirstAudioIdentifier, timeToFirstAudio.load(), nullptr);
+    }
+    valueTree.setProperty(profileIdentifier, getProfile(), nullptr);
+    valueTree.setProperty(perfCountersAvailableIdentifier, PerfCounters::isAvailable(), nullptr);
+    valueTree.setProperty(rtViolationsIdentifier, RealtimeCheck::getNumViolations(), nullptr);
+    if (TraceRecorder::getInstance().takeDumpRequest()) {
+        dumpTrace();
+    }
+    
+}
+
+MemoryBlock EbeamerAudioProcessor::getProfile() const {
+    const auto bf = activeBeamformer.load();
+    std::vector<float> data;
+    for (auto stageIdx = 0; stageIdx < StageProfiler::numStages; ++stageIdx) {
+        const auto stage = StageProfiler::Stage(stageIdx);
+        auto snapshot = profiler.getSnapshot(stage);
+        if (bf != nullptr) {
+            snapshot += bf->getProfiler().getSnapshot(stage);
+        }
+        data.push_back(snapshot.getPercentile(0.5) * 1e6f);
+        data.push_back(snapshot.getPercentile(0.99) * 1e6f);
+        data.push_back(snapshot.max * 1e6f);
+        data.push_back(float(snapshot.overruns));
+        for (auto counterIdx = 0; counterIdx < PerfCounters::numCounters; ++counterIdx) {
+            data.push_back(snapshot.countedRuns > 0 ? float(snapshot.events.values[counterIdx]) / snapshot.countedRuns
+                                                    : 0.f);
+        }
+    }
+    
+    /** Same layout as the meters: version, number of stages, then the values of each stage */
+    MemoryBlock mb(2 + data.size() * sizeof(float));
+    mb[0] = 2;
+    mb[1] = char(StageProfiler::numStages);
+    mb.copyFrom(data.data(), 2, data.size() * sizeof(float));
+    return mb;
+}
+
+void EbeamerAudioProcessor::dumpTrace() {
+    const auto file = TraceRecorder::getTraceDirectory().getChildFile(
+            "trace-" + Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".json");
+    if (TraceRecorder::getInstance().dump(file)) {
+        valueTree.setProperty(traceFileIdentifier, file.getFullPathName(), nullptr);
+    }
+}
@@ -1,222 +1,489 @@
-/*
- eBeamer Plugin Processor
- 
- Authors:
- Luca Bondi (luca.bondi@polimi.it)
- */
-
-#pragma once
-
-#include "../JuceLibraryCode/JuceHeader.h"
-#include "MeterDecay.h"
-#include "Beamformer.h"
-
-//==============================================================================
-
-class EbeamerAudioProcessor :
-public AudioProcessor,
-public AudioProcessorValueTreeState::Listener,
-public ValueTree::Listener,
-public MidiCC::Callback,
-public Timer
-{
-public:
-    
-    //==============================================================================
-    // JUCE plugin methods
-    
-    EbeamerAudioProcessor();
-    
-    ~EbeamerAudioProcessor();
-    
-    const String getName() const override;
-    
-    bool acceptsMidi() const override;
-    
-    bool producesMidi() const override;
-    
-    bool isMidiEffect() const override;
-    
-    double getTailLengthSeconds() const override;
-    
-    bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
-    
-    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
-    
-    void processBlock(AudioBuffer<float> &, MidiBuffer &) override;
-    
-    void releaseResources() override;
-    
-    int getNumPrograms() override;
-    
-    int getCurrentProgram() override;
-    
-    void setCurrentProgram(int index) override;
-    
-    const String getProgramName(int index) override;
-    
-    void changeProgramName(int index, const String &newName) override;
-    
-    AudioProcessorEditor *createEditor() override;
-    
-    bool hasEditor() const override;
-    
-    void getStateInformation(MemoryBlock &destData) override;
-    
-    void setStateInformation(const void *data, int sizeInBytes) override;
-    
-    //==============================================================================
-    // MidiCC Callback
-    /** Start learning the specified parameter */
-    void startCCLearning(const String &p) override;
-    
-    /** Stop learning the previous parameter */
-    void stopCCLearning() override;
-    
-    /** Get parameter being learned */
-    String getCCLearning() const override;
-    
-    /** Get a read-only reference to the parameters to CC mapping */
-    const std::map<String, MidiCC> &getParamToCCMapping() override;
-    
-    /** Remove mapping between MidiCC and parameter */
-    void removeCCParamMapping(const String &param) override;
-
-private:
-    //==============================================================================
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EbeamerAudioProcessor)
-    
-    //==============================================================================
-    /** Number of active input channels */
-    juce::uint32 numActiveInputChannels = 0;
-    /** Number of active output channels */
-    juce::uint32 numActiveOutputChannels = 0;
-    
-    //==============================================================================
-    /** Time Constant for input gain variations */
-    const float gainTimeConst = 0.1;
-    /** Input gain, common to all microphones */
-    dsp::Gain<float> micGain;
-    /** Beam gain for each beam */
-    dsp::Gain<float> beamGain[2];
-    
-    //==============================================================================
-    /** Previous HPF cut frequency */
-    float prevHpfFreq = 0;
-    /** Coefficients of the IIR HPF */
-    IIRCoefficients iirCoeffHPF;
-    /** IIR HPF */
-    std::vector<IIRFilter> iirHPFfilters;
-    
-    //==============================================================================
-    /** The active beamformer */
-    std::unique_ptr<Beamformer> beamformer;
-    
-    //==============================================================================
-    // Meters
-    std::unique_ptr<MeterDecay> inputMeterDecay;
-    std::unique_ptr<MeterDecay> beamMeterDecay;
-    
-    /** Decay of  meters [s] */
-    const float metersDecay = 0.3;
-    
-    //==============================================================================
-    // Timer to push cpu load, meters, energy updates at a human rate
-    void timerCallback() override;
-    
-    /** Meters update rate [Hz] */
-    const float metersUpdateRate = 15;
-    
-    //==============================================================================
-    // Beams buffers
-    AudioBuffer<float> beamBuffer;
-    
-    //==============================================================================
-    /** Lock to prevent releaseResources being called when processBlock is running. AudioPluginHost does it. */
-    SpinLock processingLock;
-    
-    /** Resources for runtime are allocated.
-     
-     This flag is used to compensate for out-of-order calls to prepareToPlay, processBlock and releaseResources
-     */
-    bool resourcesAllocated = false;
-    
-    /** Sample rate [Hz] */
-    float sampleRate = 48000;
-    
-    /** Maximum number of samples per block */
-    int maximumExpectedSamplesPerBlock = 4096;
-    
-    //==============================================================================
-    
-    /** Measured average load */
-    float load = 0;
-    /** Load time constant [s] */
-    const float loadTimeConst = 1;
-    /** Load update factor (the higher the faster the update) */
-    float loadAlpha = 1;
-    /** Load lock */
-    SpinLock loadLock;
-    
-    //==============================================================================
-        
-    /** Processor parameters tree */
-    AudioProcessorValueTreeState parameters;
-    
-    //==============================================================================
-    // VST parameters
-    std::atomic<float> *steerBeamXParam[2];
-    std::atomic<float> *steerBeamYParam[2];
-    std::atomic<float> *widthBeamParam[2];
-    std::atomic<float> *panBeamParam[2];
-    std::atomic<float> *levelBeamParam[2];
-    std::atomic<float> *muteBeamParam[2];
-    std::atomic<float> *micGainParam;
-    std::atomic<float> *hpfFreqParam;
-    std::atomic<float> *frontFacingParam;
-    std::atomic<float> *configParam;
-    
-    void parameterChanged(const String &parameterID, float newValue) override;
-    
-    //==============================================================================
-    // Parameters
-    ValueTree valueTree;
-    void valueTreePropertyChanged (ValueTree &treeWhosePropertyHasChanged, const Identifier &property) override;
-    
-    void syncParametersToValueTree();
-    
-    //==============================================================================
-    // MIDI management
-    
-    std::map<MidiCC, String> ccToParamMap;
-    std::map<String, MidiCC> paramToCcMap;
-    
-    /** Process all the received MIDI messages */
-    void processMidi(MidiBuffer &midiMessages);
-    
-    /** Process a MIDI CC message and update parameter as needed */
-    void processCC(const MidiCC &cc, int value);
-    
-    /** Insert mapping between MidiCC and parameter
-     
-     @return: true if insertion successful, false if either cc or param already mapped
-     */
-    bool insertCCParamMapping(const MidiCC &cc, const String &param);
-    
-    /** Parameter whose CC is being learned  */
-    String paramCCToLearn = "";
-    
-    //==============================================================================
-    //OSC
-    
-    /** Set a state parameter  */
-    void setParam(const Identifier&, float);
-    void setParam(const Identifier&, bool);
-    void setParam(const Identifier&, MicConfig);
-    
-    /** Message error */
-    void showConnectionErrorMessage (const String&);
-    
-    /** OSC controller instance */
-    OSCController oscController;
-};
+/*
+ eBeamer Plugin Processor
+ 
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MeterDecay.h"
+#include "Beamformer.h"
+#include "Resampler.h"
+#include "TraceRecorder.h"
+#include "RealtimeCheck.h"
+
+//==============================================================================
+/** Maximum number of beams. Parameters are allocated for all of them, the beamformer only for the active ones */
+const int maxNumBeams = 16;
+/** Default number of beams */
+const int defaultNumBeams = 2;
+/** Number of active beams parameter */
+const Identifier numBeamsIdentifier("numBeams");
+/** Maximum number of shared input groups */
+const int maxSharedInputGroup = 8;
+/** Shared input group parameter, 0 to process the input privately */
+const Identifier sharedInputIdentifier("sharedInput");
+/** Time from prepareToPlay to the first block with designed beams [s] */
+const Identifier timeToFirstAudioIdentifier("timeToFirstAudio");
+/** DOA energy available. False while the DOA filters are being designed */
+const Identifier doaReadyIdentifier("doaReady");
+/** Latency mode parameter, trading latency for processing cost */
+const Identifier latencyModeIdentifier("latencyMode");
+/** Latency modes */
+const StringArray latencyModeLabels({"Live", "Balanced", "Efficient"});
+/** Beamformer hop for each latency mode [samples] */
+const int latencyModeHops[] = {32, 128, 512};
+/** Default latency mode */
+const int defaultLatencyMode = 1;
+/** Latency reported to the host [samples] */
+const Identifier latencySamplesIdentifier("latencySamples");
+/** Internal processing rate parameter */
+const Identifier internalRateIdentifier("internalRate");
+/** Internal processing rates */
+const StringArray internalRateLabels({"Host", "48 kHz", "24 kHz"});
+/** Lowest internal rate of each option, 0 to process at the host rate [Hz].
+ The host rate is divided by the largest integer factor that keeps the internal rate at or above it.
+ */
+const float internalRates[] = {0, 48000, 24000};
+/** Input gain and HPF applied to the beams instead of the microphones parameter */
+const Identifier beamStageIdentifier("beamStage");
+/** Capsule routing table: host input channel of each capsule, 1-based, separated by spaces or commas */
+const Identifier capsuleRoutingIdentifier("capsuleRouting");
+/** Timing of the processing stages, for each StageProfiler::Stage: p50, p99 and max [us], overruns, then cycles,
+ instructions, cache misses and branch misses per run, 0 without hardware counters
+ */
+const Identifier profileIdentifier("profile");
+/** Hardware counters of the beamformer and DOA threads enabled */
+const Identifier perfCountersIdentifier("perfCounters");
+/** Hardware counters enabled and permitted by the system */
+const Identifier perfCountersAvailableIdentifier("perfCountersAvailable");
+/** Calls not real-time safe made by the audio thread, counted in EBEAMER_RT_CHECK builds only */
+const Identifier rtViolationsIdentifier("rtViolations");
+/** Trace recording of the processing threads enabled */
+const Identifier traceEnabledIdentifier("traceEnabled");
+/** Set to true to dump the trace, also done automatically on an overrun of the audio callback */
+const Identifier traceDumpIdentifier("traceDump");
+/** Chrome trace-event JSON file of the last dump */
+const Identifier traceFileIdentifier("traceFile");
+/** Number of worker threads helping the audio thread in the beamformer, 0 to run everything on the audio thread.
+ Limited to the number of cores but one, left to the host
+ */
+const Identifier beamformerWorkersIdentifier("beamformerWorkers");
+
+//==============================================================================
+
+class EbeamerAudioProcessor :
+public AudioProcessor,
+public AudioProcessorValueTreeState::Listener,
+public ValueTree::Listener,
+public MidiCC::Callback,
+public Timer
+{
+public:
+    
+    //==============================================================================
+    // JUCE plugin methods
+    
+    EbeamerAudioProcessor();
+    
+    ~EbeamerAudioProcessor();
+    
+    const String getName() const override;
+    
+    bool acceptsMidi() const override;
+    
+    bool producesMidi() const override;
+    
+    bool isMidiEffect() const override;
+    
+    double getTailLengthSeconds() const override;
+    
+    bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
+    
+    void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    
+    void processBlock(AudioBuffer<float> &, MidiBuffer &) override;
+    
+    void releaseResources() override;
+    
+    int getNumPrograms() override;
+    
+    int getCurrentProgram() override;
+    
+    void setCurrentProgram(int index) override;
+    
+    const String getProgramName(int index) override;
+    
+    void changeProgramName(int index, const String &newName) override;
+    
+    AudioProcessorEditor *createEditor() override;
+    
+    bool hasEditor() const override;
+    
+    void getStateInformation(MemoryBlock &destData) override;
+    
+    void setStateInformation(const void *data, int sizeInBytes) override;
+    
+    //==============================================================================
+    // MidiCC Callback
+    /** Start learning the specified parameter */
+    void startCCLearning(const String &p) override;
+    
+    /** Stop learning the previous parameter */
+    void stopCCLearning() override;
+    
+    /** Get parameter being learned */
+    String getCCLearning() const override;
+    
+    /** Get a read-only reference to the parameters to CC mapping */
+    const std::map<String, MidiCC> &getParamToCCMapping() override;
+    
+    /** Remove mapping between MidiCC and parameter */
+    void removeCCParamMapping(const String &param) override;
+
+private:
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EbeamerAudioProcessor)
+    
+    //==============================================================================
+    /** Number of active input channels */
+    juce::uint32 numActiveInputChannels = 0;
+    /** Number of active output channels, stereo mix */
+    juce::uint32 numActiveOutputChannels = 0;
+    /** Number of beams output: those of the active engine, or the most of the two engines during a crossfade */
+    int numBeams = defaultNumBeams;
+    
+    /** Beam channels run through the beam stage and the resampler: the most beams output since prepareToPlay.
+     Channels of removed beams are kept silent, so the filters start from a clean history if the beams are added back
+     */
+    int numBeamChannels = defaultNumBeams;
+    
+    //==============================================================================
+    // Capsules
+    
+    /** Maximum number of capsules of any configuration */
+    int maxNumCapsules = 0;
+    
+    /** Capsules used by the engines: those of the active configuration, or of both during a crossfade */
+    int numCapsules = 0;
+    
+    /** Routing table: host channel of each capsule, 0-based. Capsules beyond the table read their own channel */
+    std::vector<int> capsuleRouting;
+    
+    /** Host channel read by each capsule, -1 for capsules not connected */
+    std::vector<int> capsuleChannels;
+    
+    /** Parse and apply a capsule routing table (see capsuleRoutingIdentifier) */
+    void setCapsuleRouting(const String &routing);
+    
+    /** Map each capsule to its host channel, from the routing table and the active input channels */
+    void updateCapsuleChannels();
+    
+    //==============================================================================
+    /** Time Constant for beam gain variations */
+    const float gainTimeConst = 0.1;
+    /** Beam gain for each beam */
+    std::vector<dsp::Gain<float>> beamGain;
+    
+    //==============================================================================
+    /** Input gain and HPF, when not sharing the input */
+    InputStage inputStage;
+    
+    /** Input gain and HPF applied to the beams instead.
+     
+     Both the stage and the beamformer are linear and time invariant, so they commute: filtering the beams costs
+     numBeams channels instead of numMic. The DOA and the input meters see the raw input.
+     */
+    InputStage beamStage;
+    
+    /** The input gain and HPF are applied to the beams, set in prepareToPlay along with the shared input and swapped
+     with the engine, as the shared input depends on it
+     */
+    bool beamStageActive = false;
+    
+    /** Input shared with the other instances in the same group, nullptr when not sharing */
+    std::shared_ptr<SharedInput> sharedInput;
+    
+    /** Sequence number of the last shared input block seen, see SharedInput::claimBlock */
+    uint64 sharedInputSequence = 0;
+    
+    //==============================================================================
+    /** The active beamformer */
+    std::unique_ptr<Beamformer> beamformer;
+    
+    /** The active beamformer, for the message thread */
+    std::atomic<Beamformer *> activeBeamformer {nullptr};
+    
+    //==============================================================================
+    // Background reconfiguration
+    
+    /** Hop size and internal rate, with the FIFOs, the resamplers, the stages and the meters depending on them.
+     Mirrors the processor members of the same names, so that a new format is prepared aside and swapped in
+     */
+    struct HopFormat {
+        int hopSize = 0;
+        int hostHopSize = 0;
+        int resamplingFactor = 1;
+        float processingRate = 48000;
+        AudioBuffer<float> hopInput;
+        AudioBuffer<float> hopBeams;
+        AudioBuffer<float> engineInput;
+        AudioBuffer<float> engineBeams;
+        AudioBuffer<float> fadingBeamBuffer;
+        Decimator capsuleDecimator;
+        Interpolator beamInterpolator;
+        InputStage inputStage;
+        InputStage beamStage;
+        std::unique_ptr<MeterDecay> inputMeterDecay;
+        int crossfadeSamples = 1;
+    };
+    
+    /** A beamformer with the input it shares and the placement of the input stage, swapped as a whole */
+    struct BeamformerEngine {
+        std::unique_ptr<Beamformer> beamformer;
+        std::shared_ptr<SharedInput> sharedInput;
+        bool beamStage = false;
+        /** Format for a new hop size or internal rate, prepared with the beamformer. nullptr to keep the current one */
+        std::unique_ptr<HopFormat> format;
+    };
+    
+    /** Build a beamformer for the current parameters on the builder thread.
+     processBlock swaps it in when ready, once the filters of all its beams are designed.
+     A beamformer for a new hop size or internal rate comes with its format and is adopted by the timer instead,
+     as the hops can't be crossfaded
+     */
+    void rebuildBeamformer();
+    
+    /** Allocate and initialize a format at the current sample rate. Safe to call from the builder thread */
+    void prepareHopFormat(HopFormat &format, int newHopSize, int newResamplingFactor) const;
+    
+    /** Exchange the format in use with another one, without allocating */
+    void swapHopFormat(HopFormat &format);
+    
+    /** Switch to the beamformer and the format of a reformat engine, leaving the previous ones in the engine.
+     The beams not output yet are faded out over the first hop of the new format. No crossfade is to be in progress.
+     To be called with processingLock held, the engine is to be destroyed after releasing it
+     */
+    void adoptReformatEngine(BeamformerEngine &engine);
+    
+    /** Hop, beamformer and resamplers delay [host samples]. To be called with processingLock held */
+    int getProcessingLatency() const;
+    
+    /** Stop the builder thread and destroy the engines not in use. To be called with processingLock held */
+    void clearEngines();
+    
+    /** Thread building the new engines */
+    ThreadPool builderPool {1};
+    
+    /** Engine built and ready to replace the active one */
+    std::atomic<BeamformerEngine *> pendingEngine {nullptr};
+    
+    /** Engine built for a new hop size or internal rate, adopted by the timer */
+    std::atomic<BeamformerEngine *> reformatEngine {nullptr};
+    
+    /** Engine being faded out, owned by the audio thread */
+    std::unique_ptr<BeamformerEngine> fadingEngine;
+    
+    /** Engine faded out, destroyed by the message thread */
+    std::atomic<BeamformerEngine *> retiredEngine {nullptr};
+    
+    /** Crossfade duration between engines [s] */
+    const float crossfadeTime = 0.05;
+    
+    /** Crossfade duration between engines [samples] */
+    int crossfadeSamples = 1;
+    
+    /** Samples left to complete the crossfade */
+    int crossfadeSamplesLeft = 0;
+    
+    /** Beams of the engine being faded out */
+    AudioBuffer<float> fadingBeamBuffer;
+    
+    //==============================================================================
+    // Meters
+    std::unique_ptr<MeterDecay> inputMeterDecay;
+    std::unique_ptr<MeterDecay> beamMeterDecay;
+    
+    /** Peak of each input channel in the last hop, from the input stage */
+    std::vector<float> inputPeaks;
+    
+    /** Decay of  meters [s] */
+    const float metersDecay = 0.3;
+    
+    //==============================================================================
+    // Timer to push cpu load, meters, energy updates at a human rate
+    void timerCallback() override;
+    
+    /** Meters update rate [Hz] */
+    const float metersUpdateRate = 15;
+    
+    /** Number of worker threads helping the audio thread in the beamformer. 0 runs everything on the audio thread */
+    std::atomic<int> beamformerWorkers {0};
+    
+    //==============================================================================
+    // Beams buffers
+    AudioBuffer<float> beamBuffer;
+    
+    //==============================================================================
+    // Fixed hop processing
+    
+    /** Samples processed by the beamformer at each step, regardless of the host block size [internal rate samples].
+     
+     The input is collected in a FIFO and the beams of the previous hop are output while the next one is collected,
+     adding one hop of latency. Set by the latency mode: shorter hops cost more per second.
+     */
+    int hopSize = latencyModeHops[defaultLatencyMode];
+    
+    /** Samples of a hop at the host rate */
+    int hostHopSize = latencyModeHops[defaultLatencyMode];
+    
+    /** Input of the hop being collected, at the host rate */
+    AudioBuffer<float> hopInput;
+    
+    /** Beams of the last processed hop, at the host rate */
+    AudioBuffer<float> hopBeams;
+    
+    //==============================================================================
+    // Internal processing rate
+    
+    /** Ratio between the host rate and the internal rate of the input stage and the beamformer */
+    int resamplingFactor = 1;
+    
+    /** Internal processing rate [Hz] */
+    float processingRate = 48000;
+    
+    /** Capsules from the host rate to the internal rate */
+    Decimator capsuleDecimator;
+    
+    /** Beams from the internal rate to the host rate */
+    Interpolator beamInterpolator;
+    
+    /** Capsules of a hop at the internal rate. Refers to hopInput when not resampling */
+    AudioBuffer<float> engineInput;
+    
+    /** Beams of a hop at the internal rate. Refers to hopBeams when not resampling */
+    AudioBuffer<float> engineBeams;
+    
+    /** Samples of the hop collected so far */
+    int hopFill = 0;
+    
+    /** Process a full hop: input stage, beamformer and crossfade. The beams are written to hopBeams */
+    void processHop();
+    
+    /** Hop size for the latency mode parameter [internal rate samples] */
+    int getHopSizeParam() const;
+    
+    /** Resampling factor for the internal rate parameter, at the current sample rate */
+    int getResamplingFactorParam() const;
+    
+    //==============================================================================
+    /** Lock to prevent releaseResources being called when processBlock is running. AudioPluginHost does it. */
+    SpinLock processingLock;
+    
+    /** Resources for runtime are allocated.
+     
+     This flag is used to compensate for out-of-order calls to prepareToPlay, processBlock and releaseResources
+     */
+    bool resourcesAllocated = false;
+    
+    /** Sample rate [Hz] */
+    float sampleRate = 48000;
+    
+    /** Maximum number of samples per block */
+    int maximumExpectedSamplesPerBlock = 4096;
+    
+    //==============================================================================
+    
+    /** Measured average load */
+    float load = 0;
+    /** Load time constant [s] */
+    const float loadTimeConst = 1;
+    /** Load update factor (the higher the faster the update) */
+    float loadAlpha = 1;
+    /** Load lock */
+    SpinLock loadLock;
+    
+    /** Time of the last prepareToPlay [ticks] */
+    int64 prepareTicks = 0;
+    
+    /** Time from prepareToPlay to the first block with designed beams [s]. Negative until then */
+    std::atomic<float> timeToFirstAudio {-1};
+    
+    /** Timing of the input stage and of the output mix. The beamformer times its own stages */
+    StageProfiler profiler;
+    
+    /** Get the timing of all the stages, merging the processor and the active beamformer */
+    MemoryBlock getProfile() const;
+    
+    /** Dump the trace of the processing threads and publish the file in the valueTree */
+    void dumpTrace();
+    
+    //==============================================================================
+        
+    /** Processor parameters tree */
+    AudioProcessorValueTreeState parameters;
+    
+    //==============================================================================
+    // VST parameters
+    std::atomic<float> *steerBeamXParam[maxNumBeams];
+    std::atomic<float> *steerBeamYParam[maxNumBeams];
+    std::atomic<float> *widthBeamParam[maxNumBeams];
+    std::atomic<float> *panBeamParam[maxNumBeams];
+    std::atomic<float> *levelBeamParam[maxNumBeams];
+    std::atomic<float> *muteBeamParam[maxNumBeams];
+    std::atomic<float> *numBeamsParam;
+    std::atomic<float> *sharedInputParam;
+    std::atomic<float> *latencyModeParam;
+    std::atomic<float> *beamStageParam;
+    std::atomic<float> *internalRateParam;
+    std::atomic<float> *micGainParam;
+    std::atomic<float> *hpfFreqParam;
+    std::atomic<float> *frontFacingParam;
+    std::atomic<float> *configParam;
+    
+    void parameterChanged(const String &parameterID, float newValue) override;
+    
+    //==============================================================================
+    // Parameters
+    ValueTree valueTree;
+    void valueTreePropertyChanged (ValueTree &treeWhosePropertyHasChanged, const Identifier &property) override;
+    
+    void syncParametersToValueTree();
+    
+    //==============================================================================
+    // MIDI management
+    
+    std::map<MidiCC, String> ccToParamMap;
+    std::map<String, MidiCC> paramToCcMap;
+    
+    /** Process all the received MIDI messages */
+    void processMidi(MidiBuffer &midiMessages);
+    
+    /** Process a MIDI CC message and update parameter as needed */
+    void processCC(const MidiCC &cc, int value);
+    
+    /** Insert mapping between MidiCC and parameter
+     
+     @return: true if insertion successful, false if either cc or param already mapped
+     */
+    bool insertCCParamMapping(const MidiCC &cc, const String &param);
+    
+    /** Parameter whose CC is being learned  */
+    String paramCCToLearn = "";
+    
+    //==============================================================================
+    //OSC
+    
+    /** Set a state parameter  */
+    void setParam(const Identifier&, float);
+    void setParam(const Identifier&, bool);
+    void setParam(const Identifier&, MicConfig);
+    
+    /** Message error */
+    void showConnectionErrorMessage (const String&);
+    
+    /** OSC controller instance */
+    OSCController oscController;
+};
@@ -0,0 +1,232 @@
+/*
+  Real-time safety checks of the audio thread
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "RealtimeCheck.h"
+
+#if EBEAMER_RT_CHECK
+
+#include <cstdio>
+#include <set>
+
+#if JUCE_LINUX
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+/** Static TLS, accessed without allocating from inside the allocation hooks */
+#define EBEAMER_RT_TLS static thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define EBEAMER_RT_TLS static thread_local
+#endif
+
+/** Real-time scopes entered by the thread */
+EBEAMER_RT_TLS int realtimeDepth = 0;
+
+/** Permit scopes entered by the thread */
+EBEAMER_RT_TLS int permitDepth = 0;
+
+/** The thread is reporting a call, the calls made while reporting are not checked */
+EBEAMER_RT_TLS bool reporting = false;
+
+/** Calls reported */
+static std::atomic<int> numViolations {0};
+
+/** Allocations reported */
+static std::atomic<int> numAllocations {0};
+
+RealtimeCheck::Scope::Scope() {
+    ++realtimeDepth;
+}
+
+RealtimeCheck::Scope::~Scope() {
+    --realtimeDepth;
+}
+
+RealtimeCheck::ScopedPermit::ScopedPermit() {
+    ++permitDepth;
+}
+
+RealtimeCheck::ScopedPermit::~ScopedPermit() {
+    --permitDepth;
+}
+
+void RealtimeCheck::check(const char *call, bool isAllocation) {
+    if (realtimeDepth == 0 || permitDepth > 0 || reporting)
+        return;
+
+    reporting = true;
+    ++numViolations;
+    if (isAllocation) {
+        ++numAllocations;
+    }
+
+    /** Print each call stack once */
+    static CriticalSection reportLock;
+    static std::set<String> reportedStacks;
+    const auto stack = SystemStats::getStackBacktrace();
+    {
+        const ScopedLock l(reportLock);
+        if (reportedStacks.insert(stack).second) {
+            std::fprintf(stderr, "Real-time safety violation: %s\n%s\n", call, stack.toRawUTF8());
+        }
+    }
+
+    reporting = false;
+}
+
+int RealtimeCheck::getNumViolations() {
+    return numViolations;
+}
+
+int RealtimeCheck::getNumAllocations() {
+    return numAllocations;
+}
+
+// ==============================================================================
+#if JUCE_LINUX
+
+/** Get the next definition of an interposed function, from the C library */
+template<typename Fn>
+static Fn getNext(Fn &next, const char *name) {
+    if (next == nullptr) {
+        next = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+    }
+    return next;
+}
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    RealtimeCheck::check("malloc", true);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+    RealtimeCheck::check("calloc", true);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    RealtimeCheck::check("realloc", true);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr != nullptr) {
+        RealtimeCheck::check("free");
+    }
+    __libc_free(ptr);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    RealtimeCheck::check("pthread_mutex_lock");
+    static int (*next)(pthread_mutex_t *) = nullptr;
+    return getNext(next, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    RealtimeCheck::check("pthread_cond_wait");
+    static int (*next)(pthread_cond_t *, pthread_mutex_t *) = nullptr;
+    return getNext(next, "pthread_cond_wait")(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) {
+    RealtimeCheck::check("pthread_cond_timedwait");
+    static int (*next)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *) = nullptr;
+    return getNext(next, "pthread_cond_timedwait")(cond, mutex, abstime);
+}
+
+int sem_wait(sem_t *sem) {
+    RealtimeCheck::check("sem_wait");
+    static int (*next)(sem_t *) = nullptr;
+    return getNext(next, "sem_wait")(sem);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    RealtimeCheck::check("read");
+    static ssize_t (*next)(int, void *, size_t) = nullptr;
+    return getNext(next, "read")(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    RealtimeCheck::check("write");
+    static ssize_t (*next)(int, const void *, size_t) = nullptr;
+    return getNext(next, "write")(fd, buf, count);
+}
+
+int close(int fd) {
+    RealtimeCheck::check("close");
+    static int (*next)(int) = nullptr;
+    return getNext(next, "close")(fd);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    RealtimeCheck::check("nanosleep");
+    static int (*next)(const struct timespec *, struct timespec *) = nullptr;
+    return getNext(next, "nanosleep")(req, rem);
+}
+
+int usleep(useconds_t usec) {
+    RealtimeCheck::check("usleep");
+    static int (*next)(useconds_t) = nullptr;
+    return getNext(next, "usleep")(usec);
+}
+
+}
+
+#else
+
+void *operator new(size_t size) {
+    RealtimeCheck::check("operator new", true);
+    if (auto ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    RealtimeCheck::check("operator new[]", true);
+    if (auto ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr != nullptr) {
+        RealtimeCheck::check("operator delete");
+    }
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    if (ptr != nullptr) {
+        RealtimeCheck::check("operator delete[]");
+    }
+    std::free(ptr);
+}
+
+#endif
+
+#else
+
+void RealtimeCheck::check(const char *, bool) {
+}
+
+int RealtimeCheck::getNumViolations() {
+    return 0;
+}
+
+int RealtimeCheck::getNumAllocations() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+  Real-time safety checks of the audio thread
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Set to 1 in debug or CI builds to report the calls that aren't real-time safe on the real-time threads */
+#ifndef EBEAMER_RT_CHECK
+#define EBEAMER_RT_CHECK 0
+#endif
+
+/** Detection of allocations, locks and blocking system calls while processing audio.
+
+ Threads are real-time inside a Scope: the audio callback and the beamformer workers helping it.
+ With EBEAMER_RT_CHECK, the calls below are intercepted and, when made by a real-time thread, reported on stderr with the
+ call stack, once for each call stack, and counted:
+ - allocations: malloc, calloc, realloc and free on Linux, operator new and delete elsewhere
+ - mutex locks and condition and semaphore waits, on Linux
+ - read, write, close and sleeps, on Linux
+ On Linux the calls are interposed by symbol, effective for the code linked in the standalone and headless executables.
+ Without EBEAMER_RT_CHECK the scopes are empty and nothing is intercepted.
+ */
+class RealtimeCheck {
+public:
+
+    /** Mark the calling thread as real-time while in scope */
+    class Scope {
+    public:
+#if EBEAMER_RT_CHECK
+        Scope();
+        ~Scope();
+#else
+        Scope() {}
+#endif
+    private:
+        JUCE_DECLARE_NON_COPYABLE (Scope);
+    };
+
+    /** Permit the calls that aren't real-time safe while in scope, for the ones known and accepted, e.g. the optional
+     hardware counters read
+     */
+    class ScopedPermit {
+    public:
+#if EBEAMER_RT_CHECK
+        ScopedPermit();
+        ~ScopedPermit();
+#else
+        ScopedPermit() {}
+#endif
+    private:
+        JUCE_DECLARE_NON_COPYABLE (ScopedPermit);
+    };
+
+    /** Report a call if made by a real-time thread outside a ScopedPermit.
+
+     @param call: static name of the call
+     @param isAllocation: the call allocates memory, counted also by getNumAllocations
+     */
+    static void check(const char *call, bool isAllocation = false);
+
+    /** Get the number of calls reported since startup, 0 without EBEAMER_RT_CHECK */
+    static int getNumViolations();
+
+    /** Get the number of allocations reported since startup, 0 without EBEAMER_RT_CHECK */
+    static int getNumAllocations();
+
+};
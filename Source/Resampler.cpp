@@ -0,0 +1,167 @@
+/*
+  Polyphase resampling by integer factors
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "Resampler.h"
+
+// ==============================================================================
+int PolyphaseResampler::getDelay(int factor) {
+    /** Half the length of the odd filter, the last tap is zero */
+    return factor * tapsPerPhase / 2 - 1;
+}
+
+std::vector<float> PolyphaseResampler::designFilter(int factor) {
+
+    const int firLen = factor * tapsPerPhase - 1;
+    const double center = (firLen - 1) / 2.;
+    const double cutFreq = 0.5 / factor;
+
+    /** Kaiser window for 80 dB of attenuation */
+    const double beta = 0.1102 * (80 - 8.7);
+    auto besselI0 = [](double x) {
+        double sum = 1, term = 1;
+        for (auto k = 1; k < 32; k++) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    };
+
+    std::vector<float> filter(factor * tapsPerPhase, 0);
+    double gain = 0;
+    for (auto tapIdx = 0; tapIdx < firLen; tapIdx++) {
+        const double t = tapIdx - center;
+        const double sinc = t == 0 ? 2 * cutFreq : std::sin(2 * MathConstants<double>::pi * cutFreq * t) /
+                                                   (MathConstants<double>::pi * t);
+        const double ratio = t / center;
+        const double win = besselI0(beta * std::sqrt(jmax(0., 1 - ratio * ratio))) / besselI0(beta);
+        filter[tapIdx] = float(sinc * win);
+        gain += sinc * win;
+    }
+
+    /** Unit gain at DC */
+    for (auto &tap : filter) {
+        tap = float(tap / gain);
+    }
+    return filter;
+}
+
+void PolyphaseResampler::prepareInput(int numChannels, int historyLen_, int maxInputSamples) {
+    historyLen = historyLen_;
+    const auto numGroups = (numChannels + numLanes - 1) / numLanes;
+    input.resize(numGroups);
+    for (auto &groupInput : input) {
+        groupInput.assign(historyLen + maxInputSamples, Lanes::expand(0));
+    }
+}
+
+void PolyphaseResampler::loadInput(const AudioBuffer<float> &in, int numChannels) {
+    alignas(Lanes) float laneIn[numLanes] = {};
+    for (auto group = 0; group * numLanes < numChannels; group++) {
+        const auto firstChannel = group * numLanes;
+        const auto numGroupChannels = jmin(numLanes, numChannels - firstChannel);
+        const float *channels[numLanes];
+        for (auto lane = 0; lane < numGroupChannels; lane++) {
+            channels[lane] = in.getReadPointer(firstChannel + lane);
+        }
+        auto &groupInput = input[group];
+        for (auto sampleIdx = 0; sampleIdx < in.getNumSamples(); sampleIdx++) {
+            for (auto lane = 0; lane < numGroupChannels; lane++) {
+                laneIn[lane] = channels[lane][sampleIdx];
+            }
+            groupInput[historyLen + sampleIdx] = Lanes::fromRawArray(laneIn);
+        }
+    }
+}
+
+void PolyphaseResampler::shiftInput(int numChannels, int numSamples) {
+    for (auto group = 0; group * numLanes < numChannels; group++) {
+        auto &groupInput = input[group];
+        std::copy(groupInput.begin() + numSamples, groupInput.begin() + numSamples + historyLen, groupInput.begin());
+    }
+}
+
+void PolyphaseResampler::storeOutput(AudioBuffer<float> &out, int group, int numChannels, int sampleIdx,
+                                     const Lanes &value) {
+    alignas(Lanes) float laneOut[numLanes];
+    value.copyToRawArray(laneOut);
+    const auto firstChannel = group * numLanes;
+    for (auto lane = 0; lane < jmin(numLanes, numChannels - firstChannel); lane++) {
+        out.getWritePointer(firstChannel + lane)[sampleIdx] = laneOut[lane];
+    }
+}
+
+// ==============================================================================
+void Decimator::prepare(int factor_, int numChannels, int maxOutputSamples) {
+    factor = factor_;
+    taps = designFilter(factor);
+    prepareInput(numChannels, int(taps.size()) - 1, factor * maxOutputSamples);
+}
+
+void Decimator::process(const AudioBuffer<float> &in, AudioBuffer<float> &out, int numChannels) {
+
+    numChannels = jmin(numChannels, in.getNumChannels(), out.getNumChannels());
+    const auto numOutputSamples = out.getNumSamples();
+    jassert(in.getNumSamples() == factor * numOutputSamples);
+
+    loadInput(in, numChannels);
+
+    const auto numTaps = int(taps.size());
+    for (auto group = 0; group * numLanes < numChannels; group++) {
+        const auto &groupInput = input[group];
+        for (auto sampleIdx = 0; sampleIdx < numOutputSamples; sampleIdx++) {
+            /** Newest input sample of the output one */
+            const auto *newest = groupInput.data() + historyLen + sampleIdx * factor;
+            auto acc = Lanes::expand(0);
+            for (auto tapIdx = 0; tapIdx < numTaps; tapIdx++) {
+                acc += newest[-tapIdx] * Lanes::expand(taps[tapIdx]);
+            }
+            storeOutput(out, group, numChannels, sampleIdx, acc);
+        }
+    }
+
+    shiftInput(numChannels, in.getNumSamples());
+}
+
+// ==============================================================================
+void Interpolator::prepare(int factor_, int numChannels, int maxInputSamples) {
+    factor = factor_;
+    const auto filter = designFilter(factor);
+    phaseTaps.resize(factor);
+    for (auto phase = 0; phase < factor; phase++) {
+        phaseTaps[phase].resize(tapsPerPhase);
+        for (auto tapIdx = 0; tapIdx < tapsPerPhase; tapIdx++) {
+            phaseTaps[phase][tapIdx] = factor * filter[phase + tapIdx * factor];
+        }
+    }
+    prepareInput(numChannels, tapsPerPhase - 1, maxInputSamples);
+}
+
+void Interpolator::process(const AudioBuffer<float> &in, AudioBuffer<float> &out) {
+
+    const auto numChannels = jmin(in.getNumChannels(), out.getNumChannels());
+    const auto numInputSamples = in.getNumSamples();
+    jassert(out.getNumSamples() == factor * numInputSamples);
+
+    loadInput(in, numChannels);
+
+    for (auto group = 0; group * numLanes < numChannels; group++) {
+        const auto &groupInput = input[group];
+        for (auto sampleIdx = 0; sampleIdx < numInputSamples; sampleIdx++) {
+            const auto *newest = groupInput.data() + historyLen + sampleIdx;
+            for (auto phase = 0; phase < factor; phase++) {
+                const auto &branch = phaseTaps[phase];
+                auto acc = Lanes::expand(0);
+                for (auto tapIdx = 0; tapIdx < tapsPerPhase; tapIdx++) {
+                    acc += newest[-tapIdx] * Lanes::expand(branch[tapIdx]);
+                }
+                storeOutput(out, group, numChannels, sampleIdx * factor + phase, acc);
+            }
+        }
+    }
+
+    shiftInput(numChannels, numInputSamples);
+}
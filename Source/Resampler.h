@@ -0,0 +1,113 @@
+/*
+  Polyphase resampling by integer factors
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Base of the polyphase decimator and interpolator.
+
+ Both use the same linear phase lowpass, a Kaiser windowed sinc cut at half the low rate, with tapsPerPhase taps for each
+ of the factor polyphase branches:
+ - passband up to 0.41 of the low rate, ripple below 0.001 dB
+ - stopband from 0.59 of the low rate, attenuation of at least 80 dB
+ Aliases of the content between 0.5 and 0.59 of the low rate fall between 0.41 and 0.5 of the low rate only.
+ The delay of each filter is getDelay(factor) samples at the high rate.
+
+ Channels are processed in groups as wide as a SIMD register, one sample of each channel of a group at a time.
+ */
+class PolyphaseResampler {
+public:
+
+    /** Taps of each polyphase branch */
+    static constexpr int tapsPerPhase = 32;
+
+    /** Get the delay of the filter at the high rate [samples] */
+    static int getDelay(int factor);
+
+protected:
+
+    /** One sample for each channel of a group */
+    typedef dsp::SIMDRegister<float> Lanes;
+
+    /** Number of channels processed together */
+    static constexpr int numLanes = int(Lanes::SIMDNumElements);
+
+    /** Design the lowpass. factor * tapsPerPhase taps, the last one is zero */
+    static std::vector<float> designFilter(int factor);
+
+    /** Allocate the input of each group of channels.
+
+     @param numChannels: maximum number of channels
+     @param historyLen: input samples kept from the previous block
+     @param maxInputSamples: maximum input block size [samples]
+     */
+    void prepareInput(int numChannels, int historyLen, int maxInputSamples);
+
+    /** Interleave a block after the history of each group of channels */
+    void loadInput(const AudioBuffer<float> &in, int numChannels);
+
+    /** Keep the last historyLen input samples for the next block */
+    void shiftInput(int numChannels, int numSamples);
+
+    /** Write the output of a group of channels at a sample */
+    static void storeOutput(AudioBuffer<float> &out, int group, int numChannels, int sampleIdx, const Lanes &value);
+
+    /** Resampling factor */
+    int factor = 1;
+
+    /** Input samples kept from the previous block */
+    int historyLen = 0;
+
+    /** Input of each group of channels, interleaved: history first, then the last block */
+    std::vector<std::vector<Lanes>> input;
+
+};
+
+/** Lowpass filter and keep one sample out of factor */
+class Decimator : public PolyphaseResampler {
+public:
+
+    /** Prepare the filter and the history.
+
+     @param factor: ratio between the input and the output rates
+     @param numChannels: maximum number of channels
+     @param maxOutputSamples: maximum output block size [samples]
+     */
+    void prepare(int factor, int numChannels, int maxOutputSamples);
+
+    /** Downsample the first numChannels channels of in to out. in has factor times the samples of out */
+    void process(const AudioBuffer<float> &in, AudioBuffer<float> &out, int numChannels);
+
+private:
+
+    /** Filter taps */
+    std::vector<float> taps;
+
+};
+
+/** Insert factor - 1 zeros between samples and lowpass filter, computing each output sample from a single branch */
+class Interpolator : public PolyphaseResampler {
+public:
+
+    /** Prepare the filter and the history.
+
+     @param factor: ratio between the output and the input rates
+     @param numChannels: maximum number of channels
+     @param maxInputSamples: maximum input block size [samples]
+     */
+    void prepare(int factor, int numChannels, int maxInputSamples);
+
+    /** Upsample the channels of in to out. out has factor times the samples of in */
+    void process(const AudioBuffer<float> &in, AudioBuffer<float> &out);
+
+private:
+
+    /** Taps of each branch, scaled by the factor to preserve the gain: phaseTaps[phase][tap] */
+    std::vector<std::vector<float>> phaseTaps;
+
+};
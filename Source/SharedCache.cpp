@@ -0,0 +1,15 @@
+/*
+  Process-wide cache of immutable objects
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "SharedCache.h"
+
+std::shared_ptr<juce::dsp::FFT> getSharedFft(int order) {
+    static SharedCache<int, juce::dsp::FFT> fftCache;
+    return fftCache.get(order, [order]() {
+        return std::make_shared<juce::dsp::FFT>(order);
+    });
+}
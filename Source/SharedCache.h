@@ -0,0 +1,69 @@
+/*
+  Process-wide cache of immutable objects
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Process-wide, thread-safe cache of shared objects.
+
+ Objects are created by the first user asking for a key and released with the last shared_ptr referring to them,
+ so instances and reconfigurations running at the same time share them.
+ Objects must be immutable once created, or synchronize their own state.
+ */
+template<typename Key, typename T>
+class SharedCache {
+public:
+
+    /** Get the object for a key, creating it if no one is holding it.
+
+     @param key: object identity
+     @param create: factory called, under the cache lock, if the object is not in the cache
+     */
+    std::shared_ptr<T> get(const Key &key, const std::function<std::shared_ptr<T>()> &create) {
+
+        const ScopedLock lock(cacheLock);
+
+        /** Drop the objects no one is holding anymore */
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = it->second.expired() ? cache.erase(it) : std::next(it);
+        }
+
+        auto obj = cache[key].lock();
+        if (obj == nullptr) {
+            obj = create();
+            cache[key] = obj;
+        }
+        return obj;
+    }
+
+    /** Get the object for a key if someone is holding it, nullptr otherwise.
+
+     Lets the caller create a long to build object without holding the cache lock, then share it with get.
+     */
+    std::shared_ptr<T> find(const Key &key) {
+
+        const ScopedLock lock(cacheLock);
+
+        auto it = cache.find(key);
+        return it != cache.end() ? it->second.lock() : nullptr;
+    }
+
+private:
+
+    CriticalSection cacheLock;
+
+    std::map<Key, std::weak_ptr<T>> cache;
+
+};
+
+/** Get a shared FFT object of the given order.
+
+ FFT objects are immutable after construction, but some engines, e.g. the JUCE fallback, lock while transforming.
+ Shared FFT objects are meant for filter design and for sizing buffers, threads transforming in real time use their own.
+ */
+std::shared_ptr<juce::dsp::FFT> getSharedFft(int order);
@@ -0,0 +1,315 @@
+/*
+  Input stage shared across plugin instances
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "SharedInput.h"
+
+// ==============================================================================
+void InputStage::prepare(double sampleRate_, int maximumExpectedSamplesPerBlock, int numChannels_, float gainDb) {
+
+    sampleRate = sampleRate_;
+    numChannels = numChannels_;
+
+    /** Initialize the input gain */
+    micGain.reset(sampleRate, gainTimeConst);
+    micGain.setCurrentAndTargetValue(Decibels::decibelsToGain(gainDb));
+    gainRamp.resize(maximumExpectedSamplesPerBlock);
+
+    /** Initialize the High Pass Filters */
+    const auto numGroups = (numChannels + numLanes - 1) / numLanes;
+    hpfState1.assign(numGroups, Lanes::expand(0));
+    hpfState2.assign(numGroups, Lanes::expand(0));
+    prevHpfFreq = 0;
+    padSamples.resize(maximumExpectedSamplesPerBlock);
+}
+
+struct InputStage::GroupState {
+    Lanes b0, b1, b2, a1, a2;
+    Lanes state1, state2;
+    Lanes peak;
+};
+
+forcedinline void InputStage::processTile(GroupState &state, float *const *channels, const float *gains, int firstSample,
+                             int numTileSamples) {
+
+    /** Transpose to one register per sample. With a full tile the bounds are known and the copies become shuffles */
+    alignas(Lanes) float tile[numLanes * numLanes];
+    for (auto lane = 0; lane < numLanes; lane++) {
+        for (auto sampleIdx = 0; sampleIdx < numTileSamples; sampleIdx++) {
+            tile[sampleIdx * numLanes + lane] = channels[lane][firstSample + sampleIdx];
+        }
+    }
+
+    for (auto sampleIdx = 0; sampleIdx < numTileSamples; sampleIdx++) {
+        const auto in = Lanes::fromRawArray(tile + sampleIdx * numLanes) * Lanes::expand(gains[sampleIdx]);
+        state.peak = Lanes::max(state.peak, Lanes::abs(in));
+        const auto out = state.b0 * in + state.state1;
+        state.state1 = state.b1 * in - state.a1 * out + state.state2;
+        state.state2 = state.b2 * in - state.a2 * out;
+        out.copyToRawArray(tile + sampleIdx * numLanes);
+    }
+
+    for (auto lane = 0; lane < numLanes; lane++) {
+        for (auto sampleIdx = 0; sampleIdx < numTileSamples; sampleIdx++) {
+            channels[lane][firstSample + sampleIdx] = tile[sampleIdx * numLanes + lane];
+        }
+    }
+}
+
+void InputStage::process(AudioBuffer<float> &buffer, int numBufferChannels, float gainDb, float hpfFreq, float *peaks) {
+
+    const auto numSamples = buffer.getNumSamples();
+    numBufferChannels = jmin(numBufferChannels, numChannels, buffer.getNumChannels());
+    jassert(numSamples <= int(gainRamp.size()));
+
+    /** Gain of each sample, common to all the channels */
+    micGain.setTargetValue(Decibels::decibelsToGain(gainDb));
+    for (auto sampleIdx = 0; sampleIdx < numSamples; sampleIdx++) {
+        gainRamp[sampleIdx] = micGain.getNextValue();
+    }
+
+    /** Renew IIR coefficient if cut frequency changed */
+    if (prevHpfFreq != hpfFreq) {
+        iirCoeffHPF = IIRCoefficients::makeHighPass(sampleRate, hpfFreq);
+        prevHpfFreq = hpfFreq;
+    }
+    GroupState state;
+    state.b0 = Lanes::expand(iirCoeffHPF.coefficients[0]);
+    state.b1 = Lanes::expand(iirCoeffHPF.coefficients[1]);
+    state.b2 = Lanes::expand(iirCoeffHPF.coefficients[2]);
+    state.a1 = Lanes::expand(iirCoeffHPF.coefficients[3]);
+    state.a2 = Lanes::expand(iirCoeffHPF.coefficients[4]);
+
+    /** Gain, HPF and peak of a group of channels at a time, in place.
+     The lanes beyond the last channel work on padSamples, whatever they hold
+     */
+    alignas(Lanes) float laneOut[numLanes];
+    for (auto group = 0; group * numLanes < numBufferChannels; group++) {
+        const auto firstChannel = group * numLanes;
+        const auto numGroupChannels = jmin(numLanes, numBufferChannels - firstChannel);
+        float *channels[numLanes];
+        for (auto lane = 0; lane < numLanes; lane++) {
+            channels[lane] = lane < numGroupChannels ? buffer.getWritePointer(firstChannel + lane) : padSamples.data();
+        }
+
+        state.state1 = hpfState1[group];
+        state.state2 = hpfState2[group];
+        state.peak = Lanes::expand(0);
+        const auto numFullTilesSamples = numSamples - numSamples % numLanes;
+        for (auto sampleIdx = 0; sampleIdx < numFullTilesSamples; sampleIdx += numLanes) {
+            processTile(state, channels, gainRamp.data() + sampleIdx, sampleIdx, numLanes);
+        }
+        if (numFullTilesSamples < numSamples) {
+            processTile(state, channels, gainRamp.data() + numFullTilesSamples, numFullTilesSamples,
+                        numSamples - numFullTilesSamples);
+        }
+        hpfState1[group] = state.state1;
+        hpfState2[group] = state.state2;
+
+        if (peaks != nullptr) {
+            state.peak.copyToRawArray(laneOut);
+            for (auto lane = 0; lane < numGroupChannels; lane++) {
+                peaks[firstChannel + lane] = laneOut[lane];
+            }
+        }
+    }
+}
+
+void InputStage::copyStateFrom(const InputStage &other) {
+    jassert(other.numChannels == numChannels && other.hpfState1.size() == hpfState1.size());
+    micGain = other.micGain;
+    prevHpfFreq = other.prevHpfFreq;
+    iirCoeffHPF = other.iirCoeffHPF;
+    std::copy(other.hpfState1.begin(), other.hpfState1.end(), hpfState1.begin());
+    std::copy(other.hpfState2.begin(), other.hpfState2.end(), hpfState2.begin());
+}
+
+// ==============================================================================
+bool SharedInput::Key::operator<(const Key &other) const {
+    return std::tie(group, config, sampleRate, maximumExpectedSamplesPerBlock, numChannels, beamStage) <
+           std::tie(other.group, other.config, other.sampleRate, other.maximumExpectedSamplesPerBlock,
+                    other.numChannels, other.beamStage);
+}
+
+std::shared_ptr<SharedInput> SharedInput::get(const Key &key, float gainDb, float hpfFreq) {
+    static SharedCache<Key, SharedInput> registry;
+    return registry.get(key, [&key, gainDb, hpfFreq]() {
+        return std::make_shared<SharedInput>(key, gainDb, hpfFreq);
+    });
+}
+
+uint64 SharedInput::getSignature(const AudioBuffer<float> &buffer, int numChannels) {
+    /** FNV-1a over the samples' bits */
+    uint64 signature = 14695981039346656037ull ^ uint64(buffer.getNumSamples());
+    for (auto channelIdx = 0; channelIdx < jmin(numChannels, buffer.getNumChannels()); channelIdx++) {
+        auto samples = reinterpret_cast<const uint32 *>(buffer.getReadPointer(channelIdx));
+        for (auto sampleIdx = 0; sampleIdx < buffer.getNumSamples(); sampleIdx++) {
+            signature = (signature ^ samples[sampleIdx]) * 1099511628211ull;
+        }
+    }
+    return signature;
+}
+
+SharedInput::SharedInput(const Key &key, float gainDb, float hpfFreq) : stageGainDb(gainDb), stageHpfFreq(hpfFreq) {
+    inputStage.prepare(key.sampleRate, key.maximumExpectedSamplesPerBlock, key.numChannels, gainDb);
+    stageSnapshot.prepare(key.sampleRate, key.maximumExpectedSamplesPerBlock, key.numChannels, gainDb);
+    maxClaimWaitTicks = Time::secondsToHighResolutionTicks(0.5 * key.maximumExpectedSamplesPerBlock / key.sampleRate);
+}
+
+void SharedInput::prepare(int numMic, int maximumExpectedSamplesPerBlock,
+                          const std::vector<std::shared_ptr<dsp::FFT>> &ffts) {
+    GenericScopedLock<SpinLock> lock(blockLock);
+    if (block.getNumChannels() != numMic || block.getNumSamples() < maximumExpectedSamplesPerBlock) {
+        block.setSize(numMic, maximumExpectedSamplesPerBlock);
+        blockPublished = false;
+    }
+    if (spectra.size() != ffts.size()) {
+        spectra.resize(ffts.size());
+        spectraMics.resize(ffts.size());
+        blockPublished = false;
+    }
+    for (size_t level = 0; level < ffts.size(); level++) {
+        if (spectra[level].getNumChannels() != numMic || spectra[level].getFftSize() != ffts[level]->getSize()) {
+            auto levelFft = ffts[level];
+            spectra[level] = AudioBufferFFT(numMic, levelFft);
+            blockPublished = false;
+        }
+    }
+}
+
+SharedInput::Claim SharedInput::claimBlock(uint64 signature, uint64 &sequence) {
+    const auto startTicks = Time::getHighResolutionTicks();
+    for (;;) {
+        {
+            GenericScopedLock<SpinLock> lock(blockLock);
+            if (signature != blockSignature || sequence >= blockSequence) {
+                /** A new block */
+                blockSignature = signature;
+                blockPublished = false;
+                sequence = ++blockSequence;
+                return Claim::claimed;
+            }
+            if (blockPublished) {
+                sequence = blockSequence;
+                return Claim::published;
+            }
+            if (Time::getHighResolutionTicks() - startTicks > maxClaimWaitTicks) {
+                sequence = blockSequence;
+                return Claim::timedOut;
+            }
+        }
+        /** Another instance is processing the same block */
+        Thread::yield();
+    }
+}
+
+void SharedInput::setStageParameters(const void *client, float gainDb, float hpfFreq) {
+    if (isDoaOwner(client)) {
+        stageGainDb = gainDb;
+        stageHpfFreq = hpfFreq;
+    }
+}
+
+void SharedInput::processInputStage(AudioBuffer<float> &buffer, int numChannels, float *peaks) {
+    inputStage.process(buffer, numChannels, stageGainDb, stageHpfFreq, peaks);
+    GenericScopedLock<SpinLock> lock(stageLock);
+    stageSnapshot.copyStateFrom(inputStage);
+}
+
+void SharedInput::processInputStage(InputStage &stage, AudioBuffer<float> &buffer, int numChannels, float *peaks) {
+    {
+        GenericScopedLock<SpinLock> lock(stageLock);
+        stage.copyStateFrom(stageSnapshot);
+    }
+    stage.process(buffer, numChannels, stageGainDb, stageHpfFreq, peaks);
+}
+
+void SharedInput::publish(const AudioBuffer<float> &src, const std::vector<AudioBufferFFT> &srcSpectra,
+                          const std::vector<BigInteger> &levelMics) {
+    GenericScopedLock<SpinLock> lock(blockLock);
+    jassert(src.getNumSamples() <= block.getNumSamples());
+    blockSize = src.getNumSamples();
+    for (auto channelIdx = 0; channelIdx < block.getNumChannels(); channelIdx++) {
+        if (channelIdx < src.getNumChannels()) {
+            block.copyFrom(channelIdx, 0, src, channelIdx, 0, blockSize);
+        } else {
+            block.clear(channelIdx, 0, blockSize);
+        }
+    }
+    for (size_t level = 0; level < spectra.size(); level++) {
+        spectraMics[level] = levelMics[level];
+        if (!spectraMics[level].isZero()) {
+            spectra[level] = srcSpectra[level];
+        }
+    }
+    blockPublished = true;
+}
+
+int SharedInput::getBlock(AudioBuffer<float> &dst) {
+    GenericScopedLock<SpinLock> lock(blockLock);
+    for (auto channelIdx = 0; channelIdx < block.getNumChannels(); channelIdx++) {
+        dst.copyFrom(channelIdx, 0, block, channelIdx, 0, blockSize);
+    }
+    return blockSize;
+}
+
+void SharedInput::getSpectra(int level, AudioBufferFFT &dst, BigInteger &mics) {
+    GenericScopedLock<SpinLock> lock(blockLock);
+    mics = spectraMics[level];
+    if (!mics.isZero()) {
+        dst = spectra[level];
+    }
+}
+
+void SharedInput::attach(const void *client, int numLevels) {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    clients.push_back({client, std::vector<BigInteger>(numLevels)});
+}
+
+void SharedInput::detach(const void *client) {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [client](const Client &c) {
+        return c.id == client;
+    }), clients.end());
+}
+
+void SharedInput::requestMics(const void *client, const std::vector<BigInteger> &levelMics) {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    for (auto &c : clients) {
+        if (c.id == client) {
+            jassert(c.levelMics.size() == levelMics.size());
+            std::copy(levelMics.begin(), levelMics.end(), c.levelMics.begin());
+            return;
+        }
+    }
+}
+
+void SharedInput::addRequestedMics(std::vector<BigInteger> &levelMics) const {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    for (const auto &c : clients) {
+        for (size_t level = 0; level < jmin(levelMics.size(), c.levelMics.size()); level++) {
+            levelMics[level] |= c.levelMics[level];
+        }
+    }
+}
+
+bool SharedInput::isDoaOwner(const void *client) const {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    return !clients.empty() && clients.front().id == client;
+}
+
+void SharedInput::setDoaEnergy(const Mtx &energy) {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    doaEnergy = energy;
+}
+
+bool SharedInput::getDoaEnergy(Mtx &energy) const {
+    GenericScopedLock<SpinLock> lock(clientsLock);
+    if (doaEnergy.size() == 0)
+        return false;
+    energy = doaEnergy;
+    return true;
+}
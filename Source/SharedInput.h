@@ -0,0 +1,298 @@
+/*
+  Input stage shared across plugin instances
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioBufferFFT.h"
+#include "SignalProcessing.h"
+#include "SharedCache.h"
+
+// ==============================================================================
+
+/** Input gain and high pass filter, common to all the microphones.
+
+ The gain ramp, the filter and the peak of each channel are computed in a single pass over the block, processing the
+ channels in groups as wide as a SIMD register: the biquads of a group advance together, one sample at a time.
+ The samples of a group are transposed a square tile at a time, numLanes samples of each channel, so that the channels
+ are read and written contiguously.
+ */
+class InputStage {
+public:
+
+    /** Prepare the gain and the filters.
+
+     @param sampleRate: sample rate [Hz]
+     @param maximumExpectedSamplesPerBlock: maximum block size [samples]
+     @param numChannels: number of input channels
+     @param gainDb: initial gain [dB]
+     */
+    void prepare(double sampleRate, int maximumExpectedSamplesPerBlock, int numChannels, float gainDb);
+
+    /** Apply gain and high pass filter in place.
+
+     @param buffer: input block
+     @param numBufferChannels: number of channels to process, the first ones of the buffer, up to the prepared ones
+     @param gainDb: gain [dB]
+     @param hpfFreq: high pass filter cut frequency [Hz]
+     @param peaks: if not nullptr, receives the absolute peak of each processed channel after the gain, before the filter
+     */
+    void process(AudioBuffer<float> &buffer, int numBufferChannels, float gainDb, float hpfFreq,
+                 float *peaks = nullptr);
+
+    /** Continue from the gain and the filters state of another stage, prepared the same way. Doesn't allocate */
+    void copyStateFrom(const InputStage &other);
+
+private:
+
+    /** One sample for each channel of a group */
+    typedef dsp::SIMDRegister<float> Lanes;
+
+    /** Number of channels processed together */
+    static constexpr int numLanes = int(Lanes::SIMDNumElements);
+
+    /** Sample rate [Hz] */
+    double sampleRate = 48000;
+
+    /** Number of input channels */
+    int numChannels = 0;
+
+    /** Time Constant for input gain variations */
+    static constexpr float gainTimeConst = 0.1f;
+
+    /** Input gain, common to all microphones */
+    SmoothedValue<float> micGain;
+
+    /** Gain of each sample of the block being processed */
+    std::vector<float> gainRamp;
+
+    /** Previous HPF cut frequency */
+    float prevHpfFreq = 0;
+
+    /** Coefficients of the IIR HPF */
+    IIRCoefficients iirCoeffHPF;
+
+    /** State of the HPF biquads, transposed direct form II, for each group of channels */
+    std::vector<Lanes> hpfState1, hpfState2;
+
+    /** Samples read and written by the lanes beyond the channels of the last group */
+    std::vector<float> padSamples;
+
+    /** Gain, HPF and peak of a tile of a group, up to numLanes samples from the first one */
+    struct GroupState;
+    static void processTile(GroupState &state, float *const *channels, const float *gains, int firstSample,
+                            int numTileSamples);
+
+};
+
+// ==============================================================================
+
+/** Input spectra and DOA shared by the instances processing the same array.
+
+ Each instance hashes its raw input and claims the block. The first instance to claim a block runs the shared input stage,
+ computes the input spectra and publishes them with the processed block, the others wait for the publication and copy
+ them, read-only. An instance waiting longer than half a block processes the block privately instead.
+ The input work is then done once per block, regardless of the number of instances.
+ Each client requests the microphones it uses at each level, the publisher computes the spectra of the union of the
+ requests only. A client needing a microphone the publisher didn't compute yet computes its spectrum on its own.
+ The DOA is computed only by the first attached client, the others read its energy. The gain and the HPF of the shared
+ input stage are set by the same client, so that the group has a single setting.
+ */
+class SharedInput {
+public:
+
+    /** Identity of the shared input */
+    struct Key {
+        /** User selected sharing group, greater than 0 */
+        int group;
+        MicConfig config;
+        double sampleRate;
+        int maximumExpectedSamplesPerBlock;
+        int numChannels;
+        /** Gain and HPF applied to the beams by each instance, the shared block is the raw input */
+        bool beamStage;
+
+        bool operator<(const Key &other) const;
+    };
+
+    /** Get the shared input for the given key, creating it if no instance is using it.
+
+     @param key: shared input identity
+     @param gainDb: initial input gain, used only when the shared input is created [dB]
+     @param hpfFreq: initial HPF cut frequency, used only when the shared input is created [Hz]
+     */
+    static std::shared_ptr<SharedInput> get(const Key &key, float gainDb, float hpfFreq);
+
+    /** Hash of a raw input block, to recognize the same block across instances */
+    static uint64 getSignature(const AudioBuffer<float> &buffer, int numChannels);
+
+    /** Constructor, use get instead */
+    SharedInput(const Key &key, float gainDb, float hpfFreq);
+
+    /** Allocate the input block and the input spectra, if not done yet.
+     
+     @param numMic: number of microphones
+     @param maximumExpectedSamplesPerBlock: maximum block size [samples]
+     @param ffts: FFT of each level of the spectra
+     */
+    void prepare(int numMic, int maximumExpectedSamplesPerBlock, const std::vector<std::shared_ptr<dsp::FFT>> &ffts);
+
+    /** Result of a claim */
+    enum class Claim {
+        /** The caller has to process the input stage and publish the spectra */
+        claimed,
+        /** The block and its spectra are published already */
+        published,
+        /** Another instance is still processing the block. The caller processes it privately, without publishing */
+        timedOut,
+    };
+
+    /** Claim a block.
+
+     A block is the same as the last claimed one if it has the same signature and the caller hasn't seen the last claimed
+     one yet, so that identical consecutive blocks, e.g. silence, are told apart.
+     Waits up to half a block if another instance is computing the same block.
+     @param signature: signature of the raw block, from getSignature
+     @param sequence: sequence number of the last block seen by the caller, 0 for none. Updated by the claim
+     */
+    Claim claimBlock(uint64 signature, uint64 &sequence);
+
+    /** Set the gain and the HPF of the shared input stage. Ignored unless the client is the one computing the DOA */
+    void setStageParameters(const void *client, float gainDb, float hpfFreq);
+
+    /** Process the shared input stage, only after a successful claim.
+
+     @param buffer: claimed block
+     @param numChannels: number of channels to process
+     @param peaks: if not nullptr, receives the absolute peak of each processed channel
+     */
+    void processInputStage(AudioBuffer<float> &buffer, int numChannels, float *peaks);
+
+    /** Process a block another instance is late to publish with a private stage, continuing from the state of the
+     shared stage after its last block.
+
+     @param stage: private stage, prepared as the shared one
+     @param buffer: block
+     @param numChannels: number of channels to process
+     @param peaks: if not nullptr, receives the absolute peak of each processed channel
+     */
+    void processInputStage(InputStage &stage, AudioBuffer<float> &buffer, int numChannels, float *peaks);
+
+    /** Publish the claimed block, after the input stage, and its spectra at each level.
+
+     @param block: processed block
+     @param spectra: input spectra, for each level
+     @param levelMics: microphones whose spectra are computed, for each level
+     */
+    void publish(const AudioBuffer<float> &block, const std::vector<AudioBufferFFT> &spectra,
+                 const std::vector<BigInteger> &levelMics);
+
+    /** Copy the last published block, after the input stage.
+     
+     @param dst: destination, with at least the number of microphones channels and the maximum block size samples
+     @return number of samples of the block
+     */
+    int getBlock(AudioBuffer<float> &dst);
+
+    /** Copy the spectra of the last published block at a level.
+
+     @param level: FFT level
+     @param dst: destination spectra
+     @param mics: receives the microphones whose spectra are published at this level
+     */
+    void getSpectra(int level, AudioBufferFFT &dst, BigInteger &mics);
+
+    /** Register a client. The first one computes the DOA
+
+     @param client: client identity
+     @param numLevels: number of FFT levels of the spectra
+     */
+    void attach(const void *client, int numLevels);
+
+    /** Unregister a client */
+    void detach(const void *client);
+
+    /** Set the microphones a client uses in the current block, for each level */
+    void requestMics(const void *client, const std::vector<BigInteger> &levelMics);
+
+    /** Add the microphones requested by all the clients, for each level, to levelMics */
+    void addRequestedMics(std::vector<BigInteger> &levelMics) const;
+
+    /** Check if a client is the one computing the DOA */
+    bool isDoaOwner(const void *client) const;
+
+    /** Set the DOA energy, from the owner */
+    void setDoaEnergy(const Mtx &energy);
+
+    /** Get the last DOA energy.
+     
+     @return false, leaving energy unchanged, if the owner hasn't computed the DOA yet
+     */
+    bool getDoaEnergy(Mtx &energy) const;
+
+private:
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedInput);
+
+    /** Shared input stage */
+    InputStage inputStage;
+
+    /** Gain of the shared input stage, from the DOA owner [dB] */
+    std::atomic<float> stageGainDb;
+
+    /** HPF cut frequency of the shared input stage, from the DOA owner [Hz] */
+    std::atomic<float> stageHpfFreq;
+
+    /** State of the shared input stage after its last block */
+    InputStage stageSnapshot;
+
+    /** Lock on the snapshot */
+    SpinLock stageLock;
+
+    /** Lock on the block state and spectra */
+    SpinLock blockLock;
+
+    /** Signature of the last claimed block */
+    uint64 blockSignature = 0;
+
+    /** Sequence number of the last claimed block, counting from 1 */
+    uint64 blockSequence = 0;
+
+    /** Longest wait for the publication of a block claimed by another instance [ticks] */
+    int64 maxClaimWaitTicks = 0;
+
+    /** Spectra of the last claimed block are published */
+    bool blockPublished = false;
+
+    /** Last published block, after the input stage */
+    AudioBuffer<float> block;
+
+    /** Number of samples of the last published block */
+    int blockSize = 0;
+
+    /** Input spectra of the last published block, for each level */
+    std::vector<AudioBufferFFT> spectra;
+
+    /** Microphones whose spectra are published, for each level */
+    std::vector<BigInteger> spectraMics;
+
+    /** A client and its requested microphones */
+    struct Client {
+        const void *id;
+        std::vector<BigInteger> levelMics;
+    };
+
+    /** Lock on clients and DOA energy */
+    mutable SpinLock clientsLock;
+
+    /** Clients, the first one owns the DOA */
+    std::vector<Client> clients;
+
+    /** Last DOA energy [dB] */
+    Mtx doaEnergy;
+
+};
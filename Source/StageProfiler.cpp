@@ -0,0 +1,120 @@
+/*
+  Real-time profiler of the processing stages
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "StageProfiler.h"
+
+/** Upper edge of the first bucket [s] */
+static const double firstBucketTime = 1e-6;
+
+String StageProfiler::getStageName(Stage stage) {
+    switch (stage) {
+        case inputStage:
+            return "inputStage";
+        case firDesign:
+            return "firDesign";
+        case inputFFT:
+            return "inputFFT";
+        case convolution:
+            return "convolution";
+        case ifft:
+            return "ifft";
+        case outputMix:
+            return "outputMix";
+        case doaCycle:
+            return "doaCycle";
+        case numStages:
+            break;
+    }
+    return {};
+}
+
+StageProfiler::Snapshot &StageProfiler::Snapshot::operator+=(const Snapshot &other) {
+    for (auto bucketIdx = 0; bucketIdx < numBuckets; bucketIdx++) {
+        counts[bucketIdx] += other.counts[bucketIdx];
+    }
+    max = jmax(max, other.max);
+    overruns += other.overruns;
+    countedRuns += other.countedRuns;
+    for (auto counterIdx = 0; counterIdx < PerfCounters::numCounters; counterIdx++) {
+        events.values[counterIdx] += other.events.values[counterIdx];
+    }
+    return *this;
+}
+
+float StageProfiler::Snapshot::getPercentile(float fraction) const {
+    uint64 total = 0;
+    for (auto count : counts) {
+        total += count;
+    }
+    if (total == 0)
+        return 0;
+
+    /** Upper edge of the bucket holding the requested run, capped by the longest run */
+    const auto target = uint64(std::ceil(fraction * total));
+    uint64 cumulative = 0;
+    for (auto bucketIdx = 0; bucketIdx < numBuckets; bucketIdx++) {
+        cumulative += counts[bucketIdx];
+        if (cumulative >= jmax(target, uint64(1))) {
+            const auto upperEdge = firstBucketTime * std::exp2(double(bucketIdx) / bucketsPerOctave);
+            return jmin(max, float(upperEdge));
+        }
+    }
+    return max;
+}
+
+void StageProfiler::record(Stage stage, int64 startTicks, double deadline) {
+
+    const auto duration = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+
+    const auto bucketIdx = duration > firstBucketTime ? int(std::ceil(std::log2(duration / firstBucketTime) *
+                                                                      bucketsPerOctave)) : 0;
+    counts[stage][jmin(bucketIdx, numBuckets - 1)].fetch_add(1, std::memory_order_relaxed);
+
+    auto prevMax = maxTime[stage].load(std::memory_order_relaxed);
+    while (duration > prevMax && !maxTime[stage].compare_exchange_weak(prevMax, float(duration),
+                                                                        std::memory_order_relaxed)) {
+    }
+
+    if (deadline > 0 && duration > deadline) {
+        overruns[stage].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void StageProfiler::recordEvents(Stage stage, const PerfCounters::Reading &reading) {
+    for (auto counterIdx = 0; counterIdx < PerfCounters::numCounters; counterIdx++) {
+        events[stage][counterIdx].fetch_add(reading.values[counterIdx], std::memory_order_relaxed);
+    }
+    countedRuns[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+StageProfiler::Snapshot StageProfiler::getSnapshot(Stage stage) const {
+    Snapshot snapshot;
+    for (auto bucketIdx = 0; bucketIdx < numBuckets; bucketIdx++) {
+        snapshot.counts[bucketIdx] = counts[stage][bucketIdx].load(std::memory_order_relaxed);
+    }
+    snapshot.max = maxTime[stage].load(std::memory_order_relaxed);
+    snapshot.overruns = overruns[stage].load(std::memory_order_relaxed);
+    snapshot.countedRuns = countedRuns[stage].load(std::memory_order_relaxed);
+    for (auto counterIdx = 0; counterIdx < PerfCounters::numCounters; counterIdx++) {
+        snapshot.events.values[counterIdx] = events[stage][counterIdx].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void StageProfiler::reset() {
+    for (auto stage = 0; stage < numStages; stage++) {
+        for (auto &count : counts[stage]) {
+            count = 0;
+        }
+        maxTime[stage] = 0;
+        overruns[stage] = 0;
+        countedRuns[stage] = 0;
+        for (auto &count : events[stage]) {
+            count = 0;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+  Real-time profiler of the processing stages
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PerfCounters.h"
+
+/** Lock-free timing of the processing stages.
+
+ Each stage has a fixed histogram of durations, with log-spaced buckets (4 per octave from 1 us to 65 ms), its maximum
+ and the number of overruns: runs longer than the real time they process.
+ Any thread can record, without locks or allocations. Statistics accumulate from the last reset.
+ When the hardware counters are available, the stages timed on threads sampling them also accumulate their events.
+ */
+class StageProfiler {
+public:
+
+    /** Processing stages */
+    enum Stage {
+        /** Input gain, HPF and meters, with the resampling to the internal rate */
+        inputStage,
+        /** Design of a beam filter, on the designer thread */
+        firDesign,
+        /** Input frames FFT */
+        inputFFT,
+        /** Convolution of the inputs with the beam filters, summed in frequency domain */
+        convolution,
+        /** Sum of the partial beams, inverse FFT and overlap and save */
+        ifft,
+        /** Beam levels, meters and output mix, on each host block */
+        outputMix,
+        /** A DOA update, on the DOA thread */
+        doaCycle,
+        numStages
+    };
+
+    /** Get the name of a stage */
+    static String getStageName(Stage stage);
+
+    /** Number of histogram buckets */
+    static constexpr int numBuckets = 64;
+
+    /** Buckets per octave */
+    static constexpr int bucketsPerOctave = 4;
+
+    /** Statistics of a stage */
+    struct Snapshot {
+        uint32 counts[numBuckets] = {};
+        /** Longest run [s] */
+        float max = 0;
+        /** Runs longer than their deadline */
+        uint32 overruns = 0;
+        /** Runs with hardware counters */
+        uint32 countedRuns = 0;
+        /** Hardware events of the counted runs */
+        PerfCounters::Reading events;
+
+        /** Merge the statistics of the same stage from another profiler */
+        Snapshot &operator+=(const Snapshot &other);
+
+        /** Upper bound of the duration of a fraction of the runs [s], 0 without runs */
+        float getPercentile(float fraction) const;
+    };
+
+    /** Record a run of a stage, ending now.
+
+     @param startTicks: start of the run, from Time::getHighResolutionTicks
+     @param deadline: real time processed by the run [s]. 0 if the stage has no deadline
+     */
+    void record(Stage stage, int64 startTicks, double deadline = 0);
+
+    /** Add the hardware events of a run of a stage.
+
+     @param reading: events counted during the run, from PerfCounters
+     */
+    void recordEvents(Stage stage, const PerfCounters::Reading &reading);
+
+    /** Get the statistics of a stage */
+    Snapshot getSnapshot(Stage stage) const;
+
+    /** Clear all the statistics. Not to be called while recording */
+    void reset();
+
+private:
+
+    /** Runs in each bucket, for each stage */
+    std::atomic<uint32> counts[numStages][numBuckets] = {};
+
+    /** Longest run for each stage [s] */
+    std::atomic<float> maxTime[numStages] = {};
+
+    /** Overruns for each stage */
+    std::atomic<uint32> overruns[numStages] = {};
+
+    /** Runs with hardware counters for each stage */
+    std::atomic<uint32> countedRuns[numStages] = {};
+
+    /** Hardware events for each stage and counter */
+    std::atomic<uint64> events[numStages][PerfCounters::numCounters] = {};
+
+};
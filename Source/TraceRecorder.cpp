@@ -0,0 +1,178 @@
+/*
+  Timeline of the processing threads, in Chrome trace-event format
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#include "TraceRecorder.h"
+
+TraceRecorder &TraceRecorder::getInstance() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+void TraceRecorder::setEnabled(bool shouldBeEnabled) {
+    const ScopedLock l(lock);
+    if (shouldBeEnabled && rings == nullptr) {
+        rings.reset(new ThreadRing[maxNumThreads]);
+    }
+    enabled.store(shouldBeEnabled, std::memory_order_release);
+}
+
+TraceRecorder::ThreadRing *TraceRecorder::getThreadRing() noexcept {
+
+    /** Releases the ring of a thread when it exits */
+    struct RingOwner {
+        ThreadRing *ring = nullptr;
+
+        ~RingOwner() {
+            if (ring != nullptr) {
+                ring->assigned.store(false, std::memory_order_release);
+            }
+        }
+    };
+    static thread_local RingOwner owner;
+
+    if (owner.ring == nullptr) {
+        for (auto ringIdx = 0; ringIdx < maxNumThreads; ringIdx++) {
+            auto &ring = rings[ringIdx];
+            bool expected = false;
+            if (ring.assigned.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                ring.numEvents.store(0, std::memory_order_release);
+                std::fill(std::begin(ring.threadName), std::end(ring.threadName), 0);
+                if (auto thread = Thread::getCurrentThread()) {
+                    thread->getThreadName().copyToUTF8(ring.threadName, sizeof(ring.threadName));
+                }
+                owner.ring = &ring;
+                break;
+            }
+        }
+    }
+    return owner.ring;
+}
+
+void TraceRecorder::record(const char *name, bool isBegin) noexcept {
+    /** Pairs with the release in setEnabled, as isEnabled is relaxed: the rings are allocated */
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (auto ring = getThreadRing()) {
+        const auto eventIdx = ring->numEvents.load(std::memory_order_relaxed);
+        auto &event = ring->events[eventIdx % ringSize];
+        event.name.store(name, std::memory_order_relaxed);
+        event.ticks.store(Time::getHighResolutionTicks(), std::memory_order_relaxed);
+        event.isBegin.store(isBegin, std::memory_order_relaxed);
+        ring->numEvents.store(eventIdx + 1, std::memory_order_release);
+    }
+}
+
+void TraceRecorder::begin(const char *name) noexcept {
+    record(name, true);
+}
+
+void TraceRecorder::end(const char *name) noexcept {
+    record(name, false);
+}
+
+void TraceRecorder::requestDump() noexcept {
+    if (isEnabled()) {
+        dumpRequested.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool TraceRecorder::takeDumpRequest() {
+    if (!dumpRequested.exchange(false))
+        return false;
+    const ScopedLock l(lock);
+    const auto nowTicks = Time::getHighResolutionTicks();
+    if (lastDumpTicks != 0 && Time::highResolutionTicksToSeconds(nowTicks - lastDumpTicks) < minDumpInterval)
+        return false;
+    lastDumpTicks = nowTicks;
+    return true;
+}
+
+/** Escape a string to be written within quotes in JSON */
+static String escapeJson(const String &text) {
+    String escaped;
+    for (auto character : text) {
+        if (character == '"' || character == '\\') {
+            escaped << '\\' << String::charToString(character);
+        } else if (character < 0x20) {
+            escaped << "\\u" << String::toHexString(int(character)).paddedLeft('0', 4);
+        } else {
+            escaped << String::charToString(character);
+        }
+    }
+    return escaped;
+}
+
+File TraceRecorder::getTraceDirectory() {
+    return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("eBeamer").getChildFile("Traces");
+}
+
+bool TraceRecorder::dump(const File &file) {
+
+    const ScopedLock l(lock);
+    if (rings == nullptr)
+        return false;
+
+    struct DumpEvent {
+        const char *name;
+        int64 ticks;
+        bool isBegin;
+    };
+
+    /** Copy the rings while the threads keep recording */
+    std::vector<std::vector<DumpEvent>> threadEvents(maxNumThreads);
+    std::vector<String> threadNames(maxNumThreads);
+    int64 firstTicks = std::numeric_limits<int64>::max();
+    for (auto ringIdx = 0; ringIdx < maxNumThreads; ringIdx++) {
+        auto &ring = rings[ringIdx];
+        const auto numEvents = ring.numEvents.load(std::memory_order_acquire);
+        const auto firstEventIdx = numEvents > uint32(ringSize) ? numEvents - ringSize : 0;
+        auto &events = threadEvents[ringIdx];
+        for (auto eventIdx = firstEventIdx; eventIdx < numEvents; eventIdx++) {
+            const auto &event = ring.events[eventIdx % ringSize];
+            events.push_back({event.name.load(std::memory_order_relaxed), event.ticks.load(std::memory_order_relaxed),
+                              event.isBegin.load(std::memory_order_relaxed)});
+        }
+
+        /** Drop the events overwritten during the copy, then the ends of scopes begun before the oldest event */
+        const auto numEventsAfter = ring.numEvents.load(std::memory_order_acquire);
+        const auto firstValidIdx = numEventsAfter >= uint32(ringSize) ? numEventsAfter - ringSize + 1 : 0;
+        auto numDropped = int(jmin<size_t>(firstValidIdx > firstEventIdx ? firstValidIdx - firstEventIdx : 0,
+                                           events.size()));
+        while (numDropped < int(events.size()) && !events[numDropped].isBegin) {
+            numDropped++;
+        }
+        events.erase(events.begin(), events.begin() + numDropped);
+
+        if (!events.empty()) {
+            firstTicks = jmin(firstTicks, events.front().ticks);
+        }
+        threadNames[ringIdx] = String::fromUTF8(ring.threadName);
+        if (threadNames[ringIdx].isEmpty()) {
+            threadNames[ringIdx] = "Host thread " + String(ringIdx);
+        }
+    }
+
+    String json;
+    json << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (auto ringIdx = 0; ringIdx < maxNumThreads; ringIdx++) {
+        const auto &events = threadEvents[ringIdx];
+        if (events.empty())
+            continue;
+        json << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ringIdx
+             << ",\"args\":{\"name\":\"" << escapeJson(threadNames[ringIdx]) << "\"}}";
+        first = false;
+        for (const auto &event : events) {
+            const auto timeUs = Time::highResolutionTicksToSeconds(event.ticks - firstTicks) * 1e6;
+            json << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"" << (event.isBegin ? "B" : "E")
+                 << "\",\"pid\":1,\"tid\":" << ringIdx << ",\"ts\":" << String(timeUs, 3) << "}";
+        }
+    }
+    json << "\n]}\n";
+
+    file.getParentDirectory().createDirectory();
+    return file.replaceWithText(json);
+}
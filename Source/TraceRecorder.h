@@ -0,0 +1,133 @@
+/*
+  Timeline of the processing threads, in Chrome trace-event format
+
+ Authors:
+ Luca Bondi (luca.bondi@polimi.it)
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Process-wide recorder of begin and end events from the processing threads.
+
+ Always compiled, enabled at runtime. When disabled, a trace scope costs a relaxed load and a branch.
+ When enabled, each thread writes fixed-size events into its own ring buffer, without locks or allocations, keeping the
+ last ringSize events. A dump writes all the rings as Chrome trace-event JSON, to be opened in chrome://tracing or
+ Perfetto to see how the audio, worker, FIR design, DOA and message threads interleave on the cores.
+ */
+class TraceRecorder {
+public:
+
+    /** Get the recorder shared by all the instances */
+    static TraceRecorder &getInstance();
+
+    /** Check if events are recorded. The only cost of a scope when disabled, the instance is not even looked up */
+    static bool isEnabled() noexcept {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /** Start or stop recording. The rings are allocated the first time recording starts.
+
+     To be called from the message thread.
+     */
+    void setEnabled(bool shouldBeEnabled);
+
+    /** Record the begin of a scope on the calling thread.
+
+     @param name: static string, only its pointer is recorded
+     */
+    void begin(const char *name) noexcept;
+
+    /** Record the end of the scope begun last on the calling thread */
+    void end(const char *name) noexcept;
+
+    /** Ask for a dump from a thread that can't write files, e.g. the audio thread on an overrun */
+    void requestDump() noexcept;
+
+    /** Check for a dump request, at most one every minDumpInterval seconds. Clears the request */
+    bool takeDumpRequest();
+
+    /** Write the rings of all the threads as Chrome trace-event JSON. To be called from the message thread
+
+     @return true if the file was written
+     */
+    bool dump(const File &file);
+
+    /** Get the directory of the dumps */
+    static File getTraceDirectory();
+
+    /** Begin and end a trace scope, when the recorder is enabled */
+    class Scope {
+    public:
+        explicit Scope(const char *name_) noexcept: name(name_) {
+            if (isEnabled()) {
+                active = true;
+                getInstance().begin(name);
+            }
+        }
+
+        ~Scope() {
+            if (active) {
+                getInstance().end(name);
+            }
+        }
+
+    private:
+        const char *name;
+        bool active = false;
+    };
+
+    /** Events kept for each thread */
+    static constexpr int ringSize = 8192;
+
+    /** Maximum number of threads recorded. Threads beyond these are not recorded */
+    static constexpr int maxNumThreads = 32;
+
+    /** Minimum time between dumps requested on overrun [s] */
+    static constexpr double minDumpInterval = 10;
+
+private:
+
+    TraceRecorder() = default;
+
+    /** A begin or end event */
+    struct Event {
+        std::atomic<const char *> name {nullptr};
+        std::atomic<int64> ticks {0};
+        std::atomic<bool> isBegin {false};
+    };
+
+    /** Ring of the events of a thread. Written by its thread only */
+    struct ThreadRing {
+        /** Assigned to a running thread. Released when the thread exits, the next thread reuses the ring */
+        std::atomic<bool> assigned {false};
+        /** Name of the thread, empty for threads not started by JUCE, e.g. the host audio thread */
+        char threadName[32] = {};
+        /** Total number of events written since the ring was assigned */
+        std::atomic<uint32> numEvents {0};
+        Event events[ringSize];
+    };
+
+    /** Get the ring of the calling thread, assigning one on its first event. nullptr if all the rings are taken */
+    ThreadRing *getThreadRing() noexcept;
+
+    /** Write an event on the calling thread */
+    void record(const char *name, bool isBegin) noexcept;
+
+    /** Recording enabled. Outside of the instance, so that checking it needs no guard on the static instance */
+    static inline std::atomic<bool> enabled {false};
+
+    /** Rings of all the threads, allocated once */
+    std::unique_ptr<ThreadRing[]> rings;
+
+    /** Dump requested */
+    std::atomic<bool> dumpRequested {false};
+
+    /** Time of the last dump [ticks] */
+    int64 lastDumpTicks = 0;
+
+    /** Lock on the allocation of the rings and on the dumps */
+    CriticalSection lock;
+
+};